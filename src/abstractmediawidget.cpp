@@ -125,6 +125,9 @@ void AbstractMediaWidget::customEvent(QEvent *event)
 			updateVideoSize();
 			mediaWidget->videoSizeChanged();
 			break;
+		case VideoOutput:
+			mediaWidget->videoOutputStarted();
+			break;
 		}
 
 		if (newValue == 0) {
@@ -87,7 +87,8 @@ public:
 		Chapters = (1 << 8),
 		Angles = (1 << 9),
 		DvdMenu = (1 << 10),
-		VideoSize = (1 << 11)
+		VideoSize = (1 << 11),
+		VideoOutput = (1 << 12) // the first picture of the current media is displayed
 	};
 
 	Q_DECLARE_FLAGS(PendingUpdates, PendingUpdate)
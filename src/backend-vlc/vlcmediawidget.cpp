@@ -88,7 +88,7 @@ bool VlcMediaWidget::init()
 		libvlc_MediaPlayerEndReached, libvlc_MediaPlayerLengthChanged,
 		libvlc_MediaPlayerSeekableChanged, libvlc_MediaPlayerStopped,
 #if LIBVLC_VERSION_MAJOR > 2
-		libvlc_MediaPlayerESAdded, libvlc_MediaPlayerESDeleted,
+		libvlc_MediaPlayerESAdded, libvlc_MediaPlayerESDeleted, libvlc_MediaPlayerVout,
 #endif
 		libvlc_MediaPlayerTimeChanged };
 
@@ -116,10 +116,16 @@ bool VlcMediaWidget::init()
 
 VlcMediaWidget::~VlcMediaWidget()
 {
+	if (!vlcStream.isNull()) {
+		vlcStream->interrupt();
+	}
+
 	if (vlcMediaPlayer != NULL) {
 		libvlc_media_player_release(vlcMediaPlayer);
 	}
 
+	vlcStream.clear();
+
 	if (vlcInstance != NULL) {
 		libvlc_release(vlcInstance);
 	}
@@ -272,6 +278,33 @@ void VlcMediaWidget::setDeinterlacing(MediaWidget::DeinterlaceMode deinterlacing
 	libvlc_video_set_deinterlace(vlcMediaPlayer, vlcDeinterlaceMode);
 }
 
+#if LIBVLC_VERSION_MAJOR > 2
+static int vlcStreamOpen(void *opaque, void **data, uint64_t *size)
+{
+	MediaStream *stream = static_cast<MediaStream *>(opaque);
+	*data = stream;
+	// the size isn't known (live stream)
+	*size = UINT64_MAX;
+	return (stream->open() ? 0 : -1);
+}
+
+static ssize_t vlcStreamRead(void *data, unsigned char *buffer, size_t size)
+{
+	return static_cast<MediaStream *>(data)->read(reinterpret_cast<char *>(buffer),
+		int(qMin(size, size_t(1 << 30))));
+}
+
+static int vlcStreamSeek(void *data, uint64_t position)
+{
+	return (static_cast<MediaStream *>(data)->seek(qint64(position)) ? 0 : -1);
+}
+
+static void vlcStreamClose(void *data)
+{
+	static_cast<MediaStream *>(data)->close();
+}
+#endif
+
 void VlcMediaWidget::play(const MediaSource &source)
 {
 	addPendingUpdates(PlaybackStatus | DvdMenu);
@@ -321,7 +354,27 @@ void VlcMediaWidget::play(const MediaSource &source)
 
 	typeOfDevice = url.constData();
 
+	// the old stream has to be woken up, otherwise vlc can't switch the media
+	QSharedPointer<MediaStream> oldStream = vlcStream;
+
+	if (!oldStream.isNull()) {
+		oldStream->interrupt();
+	}
+
+	vlcStream = source.getStream();
+
+#if LIBVLC_VERSION_MAJOR > 2
+	if (!vlcStream.isNull()) {
+		vlcMedia = libvlc_media_new_callbacks(vlcInstance, vlcStreamOpen, vlcStreamRead,
+			vlcStreamSeek, vlcStreamClose, vlcStream.data());
+	} else {
+		vlcMedia = libvlc_media_new_location(vlcInstance, typeOfDevice);
+	}
+#else
+	vlcStream.clear();
 	vlcMedia = libvlc_media_new_location(vlcInstance, typeOfDevice);
+#endif
+
 	if (urlIsAudioCd)
 		libvlc_media_add_option(vlcMedia, "cdda-track=1");
 
@@ -407,7 +460,12 @@ void VlcMediaWidget::playDirection(int direction)
 
 void VlcMediaWidget::stop()
 {
+	if (!vlcStream.isNull()) {
+		vlcStream->interrupt();
+	}
+
 	libvlc_media_player_stop(vlcMediaPlayer);
+	vlcStream.clear();
 
 	timer->stop();
 	setCursor(Qt::BlankCursor);
@@ -794,6 +852,16 @@ void VlcMediaWidget::vlcEvent(const libvlc_event_t *event)
 	case libvlc_MediaMetaChanged:
 		pendingUpdatesToBeAdded = Metadata | Subtitles;
 		break;
+#if LIBVLC_VERSION_MAJOR > 2
+	case libvlc_MediaPlayerVout:
+		// only the appearance of the video output is interesting
+		if (event->u.media_player_vout.new_count == 0) {
+			return;
+		}
+
+		pendingUpdatesToBeAdded = VideoOutput;
+		break;
+#endif
 	case libvlc_MediaPlayerEncounteredError:
 		pendingUpdatesToBeAdded = PlaybackStatus;
 		break;
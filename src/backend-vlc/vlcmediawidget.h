@@ -92,6 +92,7 @@ private:
 
 	libvlc_instance_t *vlcInstance;
 	libvlc_media_t *vlcMedia;
+	QSharedPointer<MediaStream> vlcStream; // kept alive while vlc may read it
 	libvlc_media_player_t *vlcMediaPlayer;
 	bool playingDvd;
 	bool mouseVisible;
@@ -23,6 +23,8 @@
 #include <QDBusMetaType>
 
 #include "dbusobjects.h"
+#include "dvb/dvbdevice.h"
+#include "dvb/dvbliveview.h"
 #include "dvb/dvbmanager.h"
 #include "dvb/dvbtab.h"
 #include "playlist/playlisttab.h"
@@ -80,6 +82,88 @@ static const QDBusArgument &operator>>(const QDBusArgument &argument,
 	argument.endStructure();
 	return argument;
 }
+
+static QDBusArgument &operator<<(QDBusArgument &argument, const TelevisionDeviceStatusStruct &status)
+{
+	argument.beginStructure();
+	argument << status.deviceId << status.frontendName << status.state << status.overflowCount <<
+		status.lostBytes << status.packets << status.bitRate << status.ccErrors <<
+		status.teiPackets << status.crcErrors << status.sections << status.bufferSize <<
+		status.bufferFill << status.bufferLatency << status.sectionLatency;
+	argument.endStructure();
+	return argument;
+}
+
+static const QDBusArgument &operator>>(const QDBusArgument &argument,
+	TelevisionDeviceStatusStruct &status)
+{
+	argument.beginStructure();
+	argument >> status.deviceId >> status.frontendName >> status.state >> status.overflowCount >>
+		status.lostBytes >> status.packets >> status.bitRate >> status.ccErrors >>
+		status.teiPackets >> status.crcErrors >> status.sections >> status.bufferSize >>
+		status.bufferFill >> status.bufferLatency >> status.sectionLatency;
+	argument.endStructure();
+	return argument;
+}
+
+static QDBusArgument &operator<<(QDBusArgument &argument,
+	const TelevisionPidStatisticsStruct &statistics)
+{
+	argument.beginStructure();
+	argument << statistics.pid << statistics.packets << statistics.bitRate <<
+		statistics.ccErrors << statistics.teiPackets << statistics.crcErrors <<
+		statistics.sections;
+	argument.endStructure();
+	return argument;
+}
+
+static const QDBusArgument &operator>>(const QDBusArgument &argument,
+	TelevisionPidStatisticsStruct &statistics)
+{
+	argument.beginStructure();
+	argument >> statistics.pid >> statistics.packets >> statistics.bitRate >>
+		statistics.ccErrors >> statistics.teiPackets >> statistics.crcErrors >>
+		statistics.sections;
+	argument.endStructure();
+	return argument;
+}
+
+static QDBusArgument &operator<<(QDBusArgument &argument, const TelevisionZapTimeStruct &zapTime)
+{
+	argument.beginStructure();
+	argument << zapTime.stage << zapTime.time;
+	argument.endStructure();
+	return argument;
+}
+
+static const QDBusArgument &operator>>(const QDBusArgument &argument,
+	TelevisionZapTimeStruct &zapTime)
+{
+	argument.beginStructure();
+	argument >> zapTime.stage >> zapTime.time;
+	argument.endStructure();
+	return argument;
+}
+
+static QDBusArgument &operator<<(QDBusArgument &argument,
+	const TelevisionZapStatisticsStruct &statistics)
+{
+	argument.beginStructure();
+	argument << statistics.name << statistics.stage << statistics.count << statistics.average <<
+		statistics.minimum << statistics.maximum << statistics.histogram;
+	argument.endStructure();
+	return argument;
+}
+
+static const QDBusArgument &operator>>(const QDBusArgument &argument,
+	TelevisionZapStatisticsStruct &statistics)
+{
+	argument.beginStructure();
+	argument >> statistics.name >> statistics.stage >> statistics.count >> statistics.average >>
+		statistics.minimum >> statistics.maximum >> statistics.histogram;
+	argument.endStructure();
+	return argument;
+}
 #endif
 
 MprisRootObject::MprisRootObject(QObject *parent) : QObject(parent)
@@ -324,6 +408,14 @@ DBusTelevisionObject::DBusTelevisionObject(DvbTab *dvbTab_, QObject *parent) : Q
 {
 	qDBusRegisterMetaType<TelevisionScheduleEntryStruct>();
 	qDBusRegisterMetaType<QList<TelevisionScheduleEntryStruct> >();
+	qDBusRegisterMetaType<TelevisionDeviceStatusStruct>();
+	qDBusRegisterMetaType<QList<TelevisionDeviceStatusStruct> >();
+	qDBusRegisterMetaType<TelevisionPidStatisticsStruct>();
+	qDBusRegisterMetaType<QList<TelevisionPidStatisticsStruct> >();
+	qDBusRegisterMetaType<TelevisionZapTimeStruct>();
+	qDBusRegisterMetaType<QList<TelevisionZapTimeStruct> >();
+	qDBusRegisterMetaType<TelevisionZapStatisticsStruct>();
+	qDBusRegisterMetaType<QList<TelevisionZapStatisticsStruct> >();
 }
 
 DBusTelevisionObject::~DBusTelevisionObject()
@@ -409,4 +501,127 @@ void DBusTelevisionObject::RemoveProgram(quint32 key)
 	}
 }
 
+QList<TelevisionDeviceStatusStruct> DBusTelevisionObject::ListDeviceStatus()
+{
+	QList<TelevisionDeviceStatusStruct> entries;
+
+	foreach (const DvbDeviceConfig &deviceConfig, dvbTab->getManager()->getDeviceConfigs()) {
+		TelevisionDeviceStatusStruct entry;
+		entry.deviceId = deviceConfig.deviceId;
+		entry.frontendName = deviceConfig.frontendName;
+		entry.state = -1;
+		DvbDeviceStatistics statistics;
+
+		if (deviceConfig.device != NULL) {
+			entry.state = deviceConfig.device->getDeviceState();
+			statistics = deviceConfig.device->getStatistics();
+		}
+
+		entry.overflowCount = statistics.overflowCount;
+		entry.lostBytes = statistics.lostBytes;
+		entry.packets = statistics.total.packets;
+		entry.bitRate = statistics.total.bitRate;
+		entry.ccErrors = statistics.total.ccErrors;
+		entry.teiPackets = statistics.total.teiPackets;
+		entry.crcErrors = statistics.total.crcErrors;
+		entry.sections = statistics.total.sections;
+		entry.bufferSize = statistics.bufferSize;
+		entry.bufferFill = statistics.bufferFill;
+		entry.bufferLatency = statistics.bufferLatency;
+		entry.sectionLatency = statistics.sectionLatency;
+		entries.append(entry);
+	}
+
+	return entries;
+}
+
+QList<TelevisionPidStatisticsStruct> DBusTelevisionObject::ListPidStatistics(
+	const QString &deviceId)
+{
+	QList<TelevisionPidStatisticsStruct> entries;
+
+	foreach (const DvbDeviceConfig &deviceConfig, dvbTab->getManager()->getDeviceConfigs()) {
+		if ((deviceConfig.deviceId != deviceId) || (deviceConfig.device == NULL)) {
+			continue;
+		}
+
+		DvbDeviceStatistics statistics = deviceConfig.device->getStatistics();
+
+		for (QMap<int, DvbPidStatistics>::ConstIterator it = statistics.pids.constBegin();
+		     it != statistics.pids.constEnd(); ++it) {
+			TelevisionPidStatisticsStruct entry;
+			entry.pid = it.key();
+			entry.packets = it->packets;
+			entry.bitRate = it->bitRate;
+			entry.ccErrors = it->ccErrors;
+			entry.teiPackets = it->teiPackets;
+			entry.crcErrors = it->crcErrors;
+			entry.sections = it->sections;
+			entries.append(entry);
+		}
+
+		break;
+	}
+
+	return entries;
+}
+
+QList<TelevisionZapTimeStruct> DBusTelevisionObject::ListLastZapTimes()
+{
+	QList<TelevisionZapTimeStruct> entries;
+	const DvbZapTimes &zapTimes = dvbTab->getManager()->getLiveView()->getLastZapTimes();
+
+	for (int stage = 0; stage < DvbZapTimes::StageCount; ++stage) {
+		TelevisionZapTimeStruct entry;
+		entry.stage = DvbZapTimes::stageName(stage);
+		entry.time = zapTimes.times[stage];
+		entries.append(entry);
+	}
+
+	return entries;
+}
+
+QList<TelevisionZapStatisticsStruct> DBusTelevisionObject::ListChannelZapStatistics()
+{
+	return zapStatistics(dvbTab->getManager()->getLiveView()->getChannelZapStatistics());
+}
+
+QList<TelevisionZapStatisticsStruct> DBusTelevisionObject::ListDeviceZapStatistics()
+{
+	return zapStatistics(dvbTab->getManager()->getLiveView()->getDeviceZapStatistics());
+}
+
+QList<TelevisionZapStatisticsStruct> DBusTelevisionObject::zapStatistics(
+	const QMap<QString, DvbZapStatistics> &statistics)
+{
+	QList<TelevisionZapStatisticsStruct> entries;
+
+	for (QMap<QString, DvbZapStatistics>::ConstIterator it = statistics.constBegin();
+	     it != statistics.constEnd(); ++it) {
+		for (int stage = 0; stage < DvbZapTimes::StageCount; ++stage) {
+			const DvbZapStatistics::Histogram &histogram = it->histograms[stage];
+
+			if (histogram.count == 0) {
+				continue;
+			}
+
+			TelevisionZapStatisticsStruct entry;
+			entry.name = it.key();
+			entry.stage = DvbZapTimes::stageName(stage);
+			entry.count = histogram.count;
+			entry.average = int(histogram.sum / histogram.count);
+			entry.minimum = histogram.minimum;
+			entry.maximum = histogram.maximum;
+
+			for (int i = 0; i < DvbZapStatistics::BucketCount; ++i) {
+				entry.histogram.append(histogram.buckets[i]);
+			}
+
+			entries.append(entry);
+		}
+	}
+
+	return entries;
+}
+
 #endif /* HAVE_DVB == 1 */
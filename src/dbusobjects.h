@@ -25,13 +25,18 @@
 #include <config-kaffeine.h>
 
 class DvbTab;
+class DvbZapStatistics;
 class MainWindow;
 class MediaWidget;
 class PlaylistTab;
 
 struct MprisStatusStruct;
 struct MprisVersionStruct;
+struct TelevisionDeviceStatusStruct;
+struct TelevisionPidStatisticsStruct;
 struct TelevisionScheduleEntryStruct;
+struct TelevisionZapStatisticsStruct;
+struct TelevisionZapTimeStruct;
 
 class MprisRootObject : public QObject
 {
@@ -153,8 +158,16 @@ public slots:
 	quint32 ScheduleProgram(const QString &name, const QString &channel, const QString &begin,
 		const QString &duration, int repeat);
 	void RemoveProgram(quint32 key);
+	QList<TelevisionDeviceStatusStruct> ListDeviceStatus();
+	QList<TelevisionPidStatisticsStruct> ListPidStatistics(const QString &deviceId);
+	QList<TelevisionZapTimeStruct> ListLastZapTimes();
+	QList<TelevisionZapStatisticsStruct> ListChannelZapStatistics();
+	QList<TelevisionZapStatisticsStruct> ListDeviceZapStatistics();
 
 private:
+	static QList<TelevisionZapStatisticsStruct> zapStatistics(
+		const QMap<QString, DvbZapStatistics> &statistics);
+
 	DvbTab *dvbTab;
 };
 
@@ -192,4 +205,64 @@ struct TelevisionScheduleEntryStruct
 Q_DECLARE_METATYPE(TelevisionScheduleEntryStruct)
 Q_DECLARE_METATYPE(QList<TelevisionScheduleEntryStruct>)
 
+struct TelevisionDeviceStatusStruct
+{
+	QString deviceId;
+	QString frontendName;
+	int state; // DvbDevice::DeviceState or -1 if the device isn't present
+	int overflowCount;
+	qint64 lostBytes;
+	qint64 packets;
+	int bitRate; // bit/s
+	int ccErrors;
+	int teiPackets;
+	int crcErrors;
+	int sections;
+	int bufferSize; // bytes
+	int bufferFill; // bytes
+	int bufferLatency; // ms
+	int sectionLatency; // ms
+};
+
+Q_DECLARE_METATYPE(TelevisionDeviceStatusStruct)
+Q_DECLARE_METATYPE(QList<TelevisionDeviceStatusStruct>)
+
+struct TelevisionPidStatisticsStruct
+{
+	int pid;
+	qint64 packets;
+	int bitRate; // bit/s
+	int ccErrors;
+	int teiPackets;
+	int crcErrors;
+	int sections;
+};
+
+Q_DECLARE_METATYPE(TelevisionPidStatisticsStruct)
+Q_DECLARE_METATYPE(QList<TelevisionPidStatisticsStruct>)
+
+struct TelevisionZapTimeStruct
+{
+	QString stage;
+	int time; // ms since the channel change was requested; -1 if the stage wasn't reached
+};
+
+Q_DECLARE_METATYPE(TelevisionZapTimeStruct)
+Q_DECLARE_METATYPE(QList<TelevisionZapTimeStruct>)
+
+struct TelevisionZapStatisticsStruct
+{
+	QString name; // channel name or device id
+	QString stage;
+	int count;
+	int average; // ms
+	int minimum; // ms
+	int maximum; // ms
+	// counts below 50, 100, 200, 300, 500, 750, 1000, 1500, 2000, 3000, 5000 ms and the rest
+	QList<int> histogram;
+};
+
+Q_DECLARE_METATYPE(TelevisionZapStatisticsStruct)
+Q_DECLARE_METATYPE(QList<TelevisionZapStatisticsStruct>)
+
 #endif /* DBUSOBJECTS_H */
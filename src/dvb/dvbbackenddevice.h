@@ -49,6 +49,14 @@ public:
 
 	Q_DECLARE_FLAGS(Capabilities, Capability)
 
+	enum FrontendStatus {
+		HasSignal = (1 << 0),
+		HasCarrier = (1 << 1),
+		HasViterbi = (1 << 2),
+		HasSync = (1 << 3),
+		HasLock = (1 << 4)
+	};
+
 	enum SecTone {
 		ToneOff = 0,
 		ToneOn = 1
@@ -85,6 +93,14 @@ class DvbPidFilter
 public:
 	virtual void processData(const char data[188]) = 0;
 
+	// pointers to count packets in stream order (not necessarily adjacent)
+	virtual void processPackets(const char *const *packets, int count)
+	{
+		for (int i = 0; i < count; ++i) {
+			processData(packets[i]);
+		}
+	}
+
 protected:
 	DvbPidFilter() { }
 	virtual ~DvbPidFilter() { }
@@ -96,6 +112,14 @@ public:
 	// the crc is either valid or has appeared at least twice
 	virtual void processSection(const char *data, int size) = 0;
 
+	// only called for filters which receive changed sections only (see DvbDevice)
+	virtual void processTableComplete(int tableId, int tableIdExtension, int versionNumber)
+	{
+		Q_UNUSED(tableId)
+		Q_UNUSED(tableIdExtension)
+		Q_UNUSED(versionNumber)
+	}
+
 protected:
 	DvbSectionFilter() { }
 	virtual ~DvbSectionFilter() { }
@@ -109,9 +133,13 @@ public:
 	virtual void removePidFilter(int pid, DvbPidFilter *filter) = 0;
 	virtual void removeSectionFilter(int pid, DvbSectionFilter *filter) = 0;
 
-	// these two functions are thread-safe
+	// these functions are thread-safe
 	virtual DvbDataBuffer getBuffer() = 0;
 	virtual void writeBuffer(const DvbDataBuffer &dataBuffer) = 0;
+	virtual void writeSection(int pid, const char *data, int size) = 0; // crc is checked
+	virtual void reportOverflow(int lostBytes) = 0; // lostBytes is an estimate
+	// optional; FrontendStatus flags; backends which don't report status are polled
+	virtual void reportFrontendStatus(int status) = 0;
 
 protected:
 	DvbFrontendDevice() { }
@@ -160,6 +188,9 @@ public:
 	virtual float getFrqMHz() = 0;
 	virtual bool addPidFilter(int pid) = 0;
 	virtual void removePidFilter(int pid) = 0;
+	// sections are passed to DvbFrontendDevice::writeSection()
+	virtual bool addSectionFilter(int pid) = 0;
+	virtual void removeSectionFilter(int pid) = 0;
 	virtual void startDescrambling(const QByteArray &pmtSectionData) = 0;
 	virtual void stopDescrambling(int serviceId) = 0;
 	virtual void release() = 0;
@@ -151,6 +151,67 @@ DvbConfigDialog::DvbConfigDialog(DvbManager *manager_, QWidget *parent) : QDialo
 	createInfoFileBox->setChecked(manager->createInfoFile());
 	gridLayout->addWidget(createInfoFileBox, 2, 1);
 
+	gridLayout->addWidget(new QLabel(i18n("Device buffer size (MiB):")), 4, 0);
+
+	dvrBufferSizeBox = new QSpinBox(widget);
+	dvrBufferSizeBox->setRange(1, 256);
+	dvrBufferSizeBox->setValue(manager->getDvrBufferSize());
+	dvrBufferSizeBox->setToolTip(i18n("Larger buffers avoid data loss on high bitrate transponders. Changes apply the next time a device is used."));
+	gridLayout->addWidget(dvrBufferSizeBox, 4, 1);
+
+	gridLayout->addWidget(new QLabel(i18n("Filter PSI/SI tables in the kernel:")), 5, 0);
+
+	kernelSectionFiltersBox = new QCheckBox(widget);
+	kernelSectionFiltersBox->setChecked(manager->useKernelSectionFilters());
+	kernelSectionFiltersBox->setToolTip(i18n("Reduces the CPU load caused by EPG data. Some drivers don't support section filters properly."));
+	gridLayout->addWidget(kernelSectionFiltersBox, 5, 1);
+
+	gridLayout->addWidget(new QLabel(i18n("Record the entire transponder (MPTS):")), 6, 0);
+
+	recordEntireTransponderBox = new QCheckBox(widget);
+	recordEntireTransponderBox->setChecked(manager->recordEntireTransponder());
+	recordEntireTransponderBox->setToolTip(i18n("Recordings contain all services of the transponder. The files are much larger."));
+	gridLayout->addWidget(recordEntireTransponderBox, 6, 1);
+
+	gridLayout->addWidget(new QLabel(i18n("Receive the whole transponder above this number of PIDs:")),
+		7, 0);
+
+	fullTsThresholdBox = new QSpinBox(widget);
+	fullTsThresholdBox->setRange(0, 8192);
+	fullTsThresholdBox->setSpecialValueText(i18n("Never"));
+	fullTsThresholdBox->setValue(manager->getFullTsThreshold());
+	fullTsThresholdBox->setToolTip(i18n("Uses a single filter instead of one filter per PID. Some devices have a limited number of hardware PID filters."));
+	gridLayout->addWidget(fullTsThresholdBox, 7, 1);
+
+	gridLayout->addWidget(new QLabel(i18n("Bypass the page cache when recording:")), 8, 0);
+
+	directRecordingIoBox = new QCheckBox(widget);
+	directRecordingIoBox->setChecked(manager->useDirectRecordingIo());
+	directRecordingIoBox->setToolTip(i18n("Uses direct I/O for recordings. Keeps recordings from displacing other data in memory, but isn't supported by all file systems."));
+	gridLayout->addWidget(directRecordingIoBox, 8, 1);
+
+	gridLayout->addWidget(new QLabel(i18n("Maximum time shift size (MiB):")), 9, 0);
+
+	timeShiftSizeBox = new QSpinBox(widget);
+	timeShiftSizeBox->setRange(64, 65536);
+	timeShiftSizeBox->setValue(manager->getTimeShiftSize());
+	timeShiftSizeBox->setToolTip(i18n("The oldest data is overwritten when the time shift file is full."));
+	gridLayout->addWidget(timeShiftSizeBox, 9, 1);
+
+	gridLayout->addWidget(new QLabel(i18n("Always time shift live TV:")), 10, 0);
+
+	alwaysOnTimeShiftBox = new QCheckBox(widget);
+	alwaysOnTimeShiftBox->setChecked(manager->isAlwaysOnTimeShift());
+	alwaysOnTimeShiftBox->setToolTip(i18n("Keeps the recent past of the current channel, so that it can be rewound at any time."));
+	gridLayout->addWidget(alwaysOnTimeShiftBox, 10, 1);
+
+	gridLayout->addWidget(new QLabel(i18n("Pre-tune idle devices to likely next channels:")), 11, 0);
+
+	zapAccelerationBox = new QCheckBox(widget);
+	zapAccelerationBox->setChecked(manager->isZapAccelerationEnabled());
+	zapAccelerationBox->setToolTip(i18n("Keeps unused devices tuned to the adjacent and the recently watched channels, so that switching to them is faster. Recordings take the devices over when needed."));
+	gridLayout->addWidget(zapAccelerationBox, 11, 1);
+
 #if 0
 	// FIXME: this functionality is not working. Comment it out
 
@@ -531,12 +592,20 @@ void DvbConfigDialog::accept()
 {
 	manager->setRecordingFolder(recordingFolderEdit->text());
 	manager->setTimeShiftFolder(timeShiftFolderEdit->text());
+	manager->setTimeShiftSize(timeShiftSizeBox->value());
+	manager->setAlwaysOnTimeShift(alwaysOnTimeShiftBox->isChecked());
+	manager->setZapAccelerationEnabled(zapAccelerationBox->isChecked());
 	manager->setNamingFormat(namingFormat->text());
 	manager->setActionAfterRecording(actionAfterRecordingLineEdit->text());
 	manager->setBeginMargin(beginMarginBox->value() * 60);
 	manager->setEndMargin(endMarginBox->value() * 60);
 	manager->setOverride6937Charset(override6937CharsetBox->isChecked());
 	manager->setCreateInfoFile(createInfoFileBox->isChecked());
+	manager->setDvrBufferSize(dvrBufferSizeBox->value());
+	manager->setKernelSectionFilters(kernelSectionFiltersBox->isChecked());
+	manager->setFullTsThreshold(fullTsThresholdBox->value());
+	manager->setDirectRecordingIo(directRecordingIoBox->isChecked());
+	manager->setRecordEntireTransponder(recordEntireTransponderBox->isChecked());
 #if 0
 	manager->setScanWhenIdle(scanWhenIdleBox->isChecked());
 #endif
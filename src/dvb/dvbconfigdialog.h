@@ -102,9 +102,17 @@ private:
 	QLineEdit *timeShiftFolderEdit;
 	QSpinBox *beginMarginBox;
 	QSpinBox *endMarginBox;
+	QSpinBox *dvrBufferSizeBox;
 	QLineEdit *namingFormat;
 	QCheckBox *override6937CharsetBox;
 	QCheckBox *createInfoFileBox;
+	QCheckBox *recordEntireTransponderBox;
+	QSpinBox *fullTsThresholdBox;
+	QCheckBox *kernelSectionFiltersBox;
+	QCheckBox *directRecordingIoBox;
+	QSpinBox *timeShiftSizeBox;
+	QCheckBox *alwaysOnTimeShiftBox;
+	QCheckBox *zapAccelerationBox;
 	QCheckBox *scanWhenIdleBox;
 	QPixmap validPixmap;
 	QPixmap invalidPixmap;
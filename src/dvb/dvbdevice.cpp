@@ -22,7 +22,7 @@
 
 #include <QCoreApplication>
 #include <QDir>
-#include <unistd.h>
+#include <QThread>
 
 #include <cmath>
 
@@ -42,29 +42,46 @@ public:
 	int activeFilters;
 };
 
+/*
+ * reassembles sections in a fixed buffer; sections which are completely contained
+ * in a packet are passed on directly
+ */
+
 class DvbSectionFilterInternal : public DvbPidFilter
 {
 public:
-	DvbSectionFilterInternal() : activeSectionFilters(0), continuityCounter(0),
-		wrongCrcIndex(0), bufferValid(false)
+	enum {
+		MaximumSectionSize = 4096 // bytes (including the three byte header)
+	};
+
+	DvbSectionFilterInternal() : activeSectionFilters(0), device(NULL), pid(-1),
+		kernelFilter(false), continuityCounter(0), wrongCrcIndex(0), bufferValid(false),
+		bufferSize(0), sectionSize(0)
 	{
 		memset(wrongCrcs, 0, sizeof(wrongCrcs));
 	}
 
 	~DvbSectionFilterInternal() { }
 
-	QList<DvbSectionFilter *> sectionFilters;
+	QList<DvbSectionFilter *> sectionFilters; // only accessed by the main thread
 	int activeSectionFilters;
+	DvbDevice *device;
+	int pid;
+	bool kernelFilter; // the backend filters the sections
 
 private:
 	void processData(const char [188]);
-	void processSections(bool force);
+	void processPayload(const char *payload, int payloadLength);
+	int getSectionSize(const char *data);
+	void processSection(const char *data, int size);
 
 	unsigned char continuityCounter;
 	unsigned char wrongCrcIndex;
-	bool bufferValid;
-	QByteArray buffer;
+	bool bufferValid; // synchronized to the section boundaries
+	int bufferSize; // bytes of the current section in buffer
+	int sectionSize; // size of the current section; 0 = not known yet
 	int wrongCrcs[8];
+	char buffer[MaximumSectionSize];
 };
 
 // FIXME some debug messages may be printed too often
@@ -124,91 +141,130 @@ void DvbSectionFilterInternal::processData(const char data[188])
 			pointer = (payloadLength - 1);
 		}
 
-		if (bufferValid) {
-			buffer.append(payload + 1, pointer);
-			processSections(true);
-		} else {
-			bufferValid = true;
+		if (bufferValid && (bufferSize > 0)) {
+			// the end of the previous section
+			processPayload(payload + 1, pointer);
+
+			if (bufferSize > 0) {
+				qCDebug(logDvb, "Short section");
+			}
 		}
 
+		bufferValid = true;
+		bufferSize = 0;
+		sectionSize = 0;
 		payload += (pointer + 1);
 		payloadLength -= (pointer + 1);
 	}
 
-	buffer.append(payload, payloadLength);
-	processSections(false);
+	if (bufferValid) {
+		processPayload(payload, payloadLength);
+	}
 }
 
-void DvbSectionFilterInternal::processSections(bool force)
+void DvbSectionFilterInternal::processPayload(const char *payload, int payloadLength)
 {
-	const char *it = buffer.constBegin();
-	const char *end = buffer.constEnd();
+	while (payloadLength > 0) {
+		if (bufferSize == 0) {
+			if (quint8(payload[0]) == 0xff) {
+				// table id == 0xff means padding
+				return;
+			}
 
-	while (it != end) {
-		if (static_cast<unsigned char>(it[0]) == 0xff) {
-			// table id == 0xff means padding
-			it = end;
-			break;
+			if (payloadLength >= 3) {
+				int size = getSectionSize(payload);
+
+				if (size <= 0) {
+					return;
+				}
+
+				if (size <= payloadLength) {
+					// fast path: the section is completely contained in the packet
+					processSection(payload, size);
+					payload += size;
+					payloadLength -= size;
+					continue;
+				}
+
+				sectionSize = size;
+			}
 		}
 
-		if ((end - it) < 3) {
-			if (force) {
-				qCDebug(logDvb, "Section with stray data");
-				it = end;
+		int missing = ((sectionSize > 0) ? (sectionSize - bufferSize) : (3 - bufferSize));
+		int size = qMin(missing, payloadLength);
+		memcpy(buffer + bufferSize, payload, size);
+		bufferSize += size;
+		payload += size;
+		payloadLength -= size;
+
+		if (sectionSize == 0) {
+			if (bufferSize < 3) {
+				continue;
 			}
 
-			break;
-		}
+			sectionSize = getSectionSize(buffer);
 
-		const char *sectionEnd = (it + (((static_cast<unsigned char>(it[1]) & 0x0f) << 8) |
-			static_cast<unsigned char>(it[2])) + 3);
+			if (sectionSize <= 0) {
+				bufferSize = 0;
+				sectionSize = 0;
+				return;
+			}
+		}
 
-		if (force && (sectionEnd > end)) {
-			qCDebug(logDvb, "Short section");
-			sectionEnd = end;
+		if (bufferSize == sectionSize) {
+			processSection(buffer, bufferSize);
+			bufferSize = 0;
+			sectionSize = 0;
 		}
+	}
+}
 
-		if (sectionEnd <= end) {
-			int size = int(sectionEnd - it);
-			int crc = DvbStandardSection::verifyCrc32(it, size);
-			bool crcOk;
+int DvbSectionFilterInternal::getSectionSize(const char *data)
+{
+	int size = ((((quint8(data[1]) & 0x0f) << 8) | quint8(data[2])) + 3);
 
-			if (crc == 0) {
-				crcOk = true;
-			} else {
-				for (int i = 0;; ++i) {
-					if (i == (sizeof(wrongCrcs) / sizeof(wrongCrcs[0]))) {
-						crcOk = false;
-						wrongCrcs[wrongCrcIndex] = crc;
+	if (size > MaximumSectionSize) {
+		// drop everything until the next section start
+		qCDebug(logDvb, "Section too long (%d bytes)", size);
+		bufferValid = false;
+		return 0;
+	}
 
-						if ((++wrongCrcIndex) == i) {
-							wrongCrcIndex = 0;
-						}
+	return size;
+}
 
-						break;
-					}
+void DvbSectionFilterInternal::processSection(const char *data, int size)
+{
+	int crc = DvbStandardSection::verifyCrc32(data, size);
+	bool crcOk;
 
-					if (wrongCrcs[i] == crc) {
-						crcOk = true;
-						break;
-					}
-				}
-			}
+	if (crc == 0) {
+		crcOk = true;
+	} else {
+		++device->counters->crcErrors[pid];
+
+		for (int i = 0;; ++i) {
+			if (i == (sizeof(wrongCrcs) / sizeof(wrongCrcs[0]))) {
+				crcOk = false;
+				wrongCrcs[wrongCrcIndex] = crc;
 
-			if (crcOk) {
-				for (int i = 0; i < sectionFilters.size(); ++i) {
-					sectionFilters.at(i)->processSection(it, size);
+				if ((++wrongCrcIndex) == i) {
+					wrongCrcIndex = 0;
 				}
+
+				break;
 			}
 
-			it = sectionEnd;
-			continue;
+			if (wrongCrcs[i] == crc) {
+				crcOk = true;
+				break;
+			}
 		}
-
-		break;
 	}
 
-	buffer.remove(0, int(it - buffer.constBegin()));
+	if (crcOk) {
+		device->queueSection(pid, data, size);
+	}
 }
 
 class DvbDataDumper : public QFile, public DvbPidFilter
@@ -239,31 +295,323 @@ void DvbDataDumper::processData(const char data[188])
 	write(data, 188);
 }
 
+class DvbDemuxThread : public QThread
+{
+public:
+	explicit DvbDemuxThread(DvbDevice *device_) : device(device_) { }
+	~DvbDemuxThread() { }
+
+private:
+	void run()
+	{
+		device->demux();
+	}
+
+	DvbDevice *device;
+};
+
+DvbDeviceDataBuffer::~DvbDeviceDataBuffer()
+{
+	qFreeAligned(data);
+}
+
+void DvbDeviceDataBuffer::resize(int minimumSize)
+{
+	// the size has to be a multiple of the page size and of the packet size
+	const int granularity = (1024 * 188);
+	int newSize = (((qMax(minimumSize, 1) + granularity - 1) / granularity) * granularity);
+
+	if (newSize != size) {
+		qFreeAligned(data);
+		data = static_cast<char *>(qMallocAligned(size_t(newSize), 4096));
+
+		if (data != NULL) {
+			size = newSize;
+		} else {
+			qCWarning(logDev, "Cannot allocate a data buffer of %d bytes", newSize);
+			size = 0;
+		}
+	}
+
+	readPos = 0;
+	writePos = 0;
+	consumedBytes = 0;
+	usedSize.storeRelease(0);
+	committedBytes.storeRelease(0);
+}
+
+int DvbDeviceDataBuffer::getWritableSize() const
+{
+	return qMin(size - usedSize.loadAcquire(), size - writePos);
+}
+
+bool DvbDeviceDataBuffer::commit(int dataSize)
+{
+	Q_ASSERT((dataSize >= 0) && ((writePos + dataSize) <= size));
+	writePos += dataSize;
+
+	if (writePos == size) {
+		writePos = 0;
+	}
+
+	committedBytes.fetchAndAddOrdered(dataSize);
+	return (usedSize.fetchAndAddOrdered(dataSize) == 0);
+}
+
+int DvbDeviceDataBuffer::getReadableSize() const
+{
+	return qMin(usedSize.loadAcquire(), size - readPos);
+}
+
+int DvbDeviceDataBuffer::getUsedSize() const
+{
+	return usedSize.loadAcquire();
+}
+
+void DvbDeviceDataBuffer::consume(int dataSize)
+{
+	Q_ASSERT((dataSize >= 0) && ((readPos + dataSize) <= size));
+	readPos += dataSize;
+
+	if (readPos == size) {
+		readPos = 0;
+	}
+
+	consumedBytes += dataSize;
+	usedSize.fetchAndAddOrdered(-dataSize);
+}
+
+void DvbDeviceDataBuffer::discard(qint64 position)
+{
+	// data which was committed afterwards is kept
+	int dataSize = int(qBound(qint64(0), position - consumedBytes,
+		qint64(usedSize.loadAcquire())));
+
+	if (size > 0) {
+		readPos = ((readPos + dataSize) % size);
+	}
+
+	consumedBytes += dataSize;
+	usedSize.fetchAndAddOrdered(-dataSize);
+}
+
+void DvbStreamCounters::reset()
+{
+	memset(packets, 0, sizeof(packets));
+	memset(ccErrors, 0, sizeof(ccErrors));
+	memset(teiPackets, 0, sizeof(teiPackets));
+	memset(crcErrors, 0, sizeof(crcErrors));
+	resetContinuity();
+	maximumUsedSize = 0;
+}
+
+void DvbSectionTableState::reset(int versionNumber_, int lastSectionNumber_)
+{
+	versionNumber = versionNumber_;
+	lastSectionNumber = lastSectionNumber_;
+	complete = false;
+	memset(receivedSections, 0, sizeof(receivedSections));
+
+	for (int i = 0; i < 32; ++i) {
+		segmentLastSectionNumbers[i] = -1;
+	}
+}
+
+bool DvbSectionTableState::isComplete() const
+{
+	for (int i = 0; i <= lastSectionNumber; ++i) {
+		int segmentLastSectionNumber = segmentLastSectionNumbers[i / 8];
+
+		if (segmentLastSectionNumber >= 0) {
+			// the eit schedule is divided into segments of up to eight sections
+			if (i > segmentLastSectionNumber) {
+				i = (((i / 8) + 1) * 8) - 1;
+				continue;
+			}
+		}
+
+		if ((receivedSections[i / 32] & (1U << (i % 32))) == 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void DvbChangedSectionFilter::processSection(const char *data, int size)
+{
+	if ((size < 12) || ((data[1] & 0x80) == 0)) {
+		// no section syntax (and maybe no crc)
+		filter->processSection(data, size);
+		return;
+	}
+
+	int tableId = quint8(data[0]);
+	int tableIdExtension = ((quint8(data[3]) << 8) | quint8(data[4]));
+	int versionNumber = ((quint8(data[5]) >> 1) & 0x1f);
+	int sectionNumber = quint8(data[6]);
+	int lastSectionNumber = quint8(data[7]);
+	quint32 crc = ((quint32(quint8(data[size - 4])) << 24) | (quint8(data[size - 3]) << 16) |
+		(quint8(data[size - 2]) << 8) | quint8(data[size - 1]));
+	quint64 tableKey = ((quint64(tableId) << 16) | quint64(tableIdExtension));
+
+	if ((tableId >= 0x4e) && (tableId <= 0x6f) && (size >= 18)) {
+		// eit: the service id is only unique within a transport stream (and other
+		// transport streams are announced as well)
+		tableKey |= ((quint64(quint8(data[8])) << 56) | (quint64(quint8(data[9])) << 48) |
+			(quint64(quint8(data[10])) << 40) | (quint64(quint8(data[11])) << 32));
+	}
+
+	quint64 sectionKey = (tableKey | (quint64(sectionNumber) << 24));
+
+	if ((data[5] & 0x01) == 0) {
+		// the section isn't applicable yet
+		return;
+	}
+
+	QHash<quint64, quint32>::iterator it = sectionCrcs.find(sectionKey);
+
+	if ((it == sectionCrcs.end()) || (*it != crc)) {
+		sectionCrcs.insert(sectionKey, crc);
+		filter->processSection(data, size);
+
+		if (filter == NULL) {
+			// removed while processing the section
+			return;
+		}
+	}
+
+	DvbSectionTableState &table = tables[tableKey];
+
+	if ((table.versionNumber != versionNumber) || (table.lastSectionNumber != lastSectionNumber)) {
+		// the sections which aren't part of the new version are forgotten
+		for (int i = (lastSectionNumber + 1); i <= table.lastSectionNumber; ++i) {
+			sectionCrcs.remove(tableKey | (quint64(i) << 24));
+		}
+
+		table.reset(versionNumber, lastSectionNumber);
+	}
+
+	if (table.complete || (sectionNumber > lastSectionNumber)) {
+		return;
+	}
+
+	table.receivedSections[sectionNumber / 32] |= (1U << (sectionNumber % 32));
+
+	if ((tableId >= 0x4e) && (tableId <= 0x6f) && (size >= 18)) {
+		// eit: segment_last_section_number
+		table.segmentLastSectionNumbers[sectionNumber / 8] = quint8(data[12]);
+	}
+
+	if (table.isComplete()) {
+		table.complete = true;
+		filter->processTableComplete(tableId, tableIdExtension, versionNumber);
+	}
+}
+
+DvbPidFilterTable::DvbPidFilterTable(const QMap<int, DvbFilterInternal> &filterMap)
+{
+	memset(entries, 0, sizeof(entries));
+	filterIndexes.append(-1); // slot 0: the shared empty list
+	QMap<DvbPidFilter *, int> batchIndexes;
+	QList<DvbPidFilter *> allPidsFilters = filterMap.value(0x2000).filters;
+
+	if (allPidsFilters.isEmpty()) {
+		for (QMap<int, DvbFilterInternal>::ConstIterator it = filterMap.constBegin();
+		     it != filterMap.constEnd(); ++it) {
+			if ((it.key() >= 0) && (it.key() <= 0x1fff)) {
+				addEntry(it.key(), it->filters, batchIndexes);
+			}
+		}
+	} else {
+		for (int pid = 0; pid <= 0x1fff; ++pid) {
+			QList<DvbPidFilter *> pidFilters = filterMap.value(pid).filters;
+
+			foreach (DvbPidFilter *filter, allPidsFilters) {
+				if (!pidFilters.contains(filter)) {
+					pidFilters.append(filter);
+				}
+			}
+
+			addEntry(pid, pidFilters, batchIndexes);
+		}
+	}
+}
+
+void DvbPidFilterTable::addEntry(int pid, const QList<DvbPidFilter *> &pidFilters,
+	QMap<DvbPidFilter *, int> &batchIndexes)
+{
+	if (pidFilters.isEmpty()) {
+		return;
+	}
+
+	entries[pid] = filterIndexes.size();
+
+	foreach (DvbPidFilter *filter, pidFilters) {
+		QMap<DvbPidFilter *, int>::ConstIterator it = batchIndexes.constFind(filter);
+
+		if (it == batchIndexes.constEnd()) {
+			it = batchIndexes.insert(filter, batches.size());
+			DvbPidFilterBatch batch;
+			batch.filter = filter;
+			batch.packets.resize(MaximumBatchSize);
+			batches.append(batch);
+		}
+
+		filterIndexes.append(*it);
+	}
+
+	filterIndexes.append(-1);
+}
+
+void DvbPidFilterTable::processBatches()
+{
+	for (int i = 0; i < batches.size(); ++i) {
+		DvbPidFilterBatch &batch = batches[i];
+
+		if (batch.count > 0) {
+			batch.filter->processPackets(batch.packets.constData(), batch.count);
+			batch.count = 0;
+		}
+	}
+}
+
 DvbDevice::DvbDevice(DvbBackendDevice *backend_, QObject *parent) : QObject(parent),
-	backend(backend_), deviceState(DeviceReleased), dataDumper(NULL), cleanUpFilters(false),
-	isAuto(false), unusedBuffersHead(NULL), usedBuffersHead(NULL), usedBuffersTail(NULL)
+	backend(backend_), deviceState(DeviceReleased), dataDumper(NULL),
+	frontendTimeout(0), tuneTimestamp(-1), lockTimestamp(-1), frontendStatusReported(false),
+	seenFrontendStatus(0),
+	pendingRotorPosition(0), pendingRotorTimeout(0), rotorMovementTime(0), rotorPosition(0), rotorPositionKnown(false),
+	cleanUpSectionFilters(false), kernelSectionFilters(false), fullTsThreshold(0), pidFilterLimit(-1),
+	isAuto(false),
+	autoCandidateIndex(0), autoSignalSeen(false), dataBufferSize(4 * 1024 * 1024),
+	demuxStopped(true), sectionLatency(0), overflowCount(0), lostBytes(0)
 {
+	dataBuffer = new DvbDeviceDataBuffer;
+	dataBuffer->resize(dataBufferSize);
+	demuxThread = new DvbDemuxThread(this);
+	filterTable = new DvbPidFilterTable(filters);
+	counters = new DvbStreamCounters;
+
 	backend->setFrontendDevice(this);
 	backend->setDeviceEnabled(true); // FIXME
 
 	connect(&frontendTimer, SIGNAL(timeout()), this, SLOT(frontendEvent()));
+	diseqcTimer.setSingleShot(true);
+	connect(&diseqcTimer, SIGNAL(timeout()), this, SLOT(diseqcEvent()));
+	statisticsTimer.setInterval(10000);
+	connect(&statisticsTimer, SIGNAL(timeout()), this, SLOT(updateStatistics()));
 }
 
 DvbDevice::~DvbDevice()
 {
 	backend->release();
-
-	for (DvbDeviceDataBuffer *buffer = unusedBuffersHead; buffer != NULL;) {
-		DvbDeviceDataBuffer *nextBuffer = buffer->next;
-		delete buffer;
-		buffer = nextBuffer;
-	}
-
-	for (DvbDeviceDataBuffer *buffer = usedBuffersHead; buffer != NULL;) {
-		DvbDeviceDataBuffer *nextBuffer = buffer->next;
-		delete buffer;
-		buffer = nextBuffer;
-	}
+	stopDemux();
+	delete demuxThread;
+	delete filterTable;
+	delete counters;
+	qDeleteAll(changedSectionFilters);
+	qDeleteAll(obsoleteChangedSectionFilters);
+	delete dataBuffer;
 }
 
 DvbDevice::TransmissionTypes DvbDevice::getTransmissionTypes() const
@@ -286,24 +634,14 @@ void DvbDevice::tune(const DvbTransponder &transponder)
 	DvbTransponderBase::TransmissionType transmissionType = transponder.getTransmissionType();
 
 	autoTransponder.setTransmissionType(transmissionType);
+	diseqcTimer.stop();
 
 	if ((transmissionType != DvbTransponderBase::DvbS) &&
 	    (transmissionType != DvbTransponderBase::DvbS2)) {
-		if (backend->tune(transponder)) {
-			setDeviceState(DeviceTuning);
-			frontendTimeout = config->timeout;
-			frontendTimer.start(100);
-			discardBuffers();
-		} else {
-			setDeviceState(DeviceTuning);
-			setDeviceState(DeviceIdle);
-			autoTransponder.setTransmissionType(DvbTransponderBase::Invalid);
-		}
-
+		tuneBackend(transponder, 0);
 		return;
 	}
 
-	bool moveRotor = false;
 	DvbTransponder intermediate = transponder;
 
 	// DVB LNBf IF and DiSeqC switch settings
@@ -321,6 +659,9 @@ void DvbDevice::tune(const DvbTransponder &transponder)
 
 	// rotor
 
+	QByteArray rotorCommand;
+	double rotorTarget = 0; // degrees; only known for usals
+
 	switch (config->configuration) {
 	case DvbConfigBase::DiseqcSwitch:
 	case DvbConfigBase::NoDiseqc:
@@ -363,80 +704,80 @@ void DvbDevice::tune(const DvbTransponder &transponder)
 		}
 
 		char cmd[] = { char(0xe0), 0x31, 0x6e, char(value / 256), char(value % 256) };
-		usleep(15000);
-		backend->sendMessage(cmd, sizeof(cmd));
-		usleep(15000);
-		moveRotor = true;
+		rotorCommand = QByteArray(cmd, sizeof(cmd));
+		rotorTarget = (angle * 180 / M_PI);
 		break;
 	    }
 
 	case DvbConfigBase::PositionsRotor: {
 		char cmd[] = { char(0xe0), 0x31, 0x6b, char(config->lnbNumber) };
-		usleep(15000);
-		backend->sendMessage(cmd, sizeof(cmd));
-		usleep(15000);
-		moveRotor = true;
+		rotorCommand = QByteArray(cmd, sizeof(cmd));
 		break;
 	    }
 	}
 
-	// tune
+	if (rotorCommand.isEmpty()) {
+		tuneBackend(intermediate, 0);
+		return;
+	}
 
-	if (backend->tune(intermediate)) {
-		if (!moveRotor) {
-			setDeviceState(DeviceTuning);
-			frontendTimeout = config->timeout;
-		} else {
-			setDeviceState(DeviceRotorMoving);
-			frontendTimeout = 15000;
-		}
+	if (rotorCommand == lastRotorCommand) {
+		// the rotor is already there (or on its way)
+		int remaining = int(rotorMovementTime - rotorMovementTimer.elapsed());
+		tuneBackend(intermediate, (remaining > 0) ? (remaining + config->timeout) : 0);
+		return;
+	}
 
-		frontendTimer.start(100);
-		discardBuffers();
-	} else {
-		setDeviceState(DeviceTuning);
-		setDeviceState(DeviceIdle);
-		autoTransponder.setTransmissionType(DvbTransponderBase::Invalid);
+	/*
+	 * the time needed by the rotor is estimated from the angular distance (only known for
+	 * usals if the previous position is known); the lock ends the wait anyway
+	 */
+
+	int rotorTimeout = 15000;
+
+	if ((config->configuration == DvbConfigBase::UsalsRotor) && rotorPositionKnown) {
+		const double rotorSpeed = 1.2; // degrees per second (slow motors at 13 V)
+		rotorTimeout = qMin(int(1000 * qAbs(rotorTarget - rotorPosition) / rotorSpeed) +
+			config->timeout, 90000);
 	}
+
+	// the command is sent and the frontend is tuned by diseqcEvent() (15 ms pause each)
+	pendingRotorCommand = rotorCommand;
+	pendingRotorPosition = rotorTarget;
+	pendingTransponder = intermediate;
+	pendingRotorTimeout = rotorTimeout;
+	setDeviceState(DeviceRotorMoving);
+	diseqcTimer.start(15);
 }
 
 void DvbDevice::autoTune(const DvbTransponder &transponder)
+{
+	autoTune(transponder, QList<DvbTransponder>());
+}
+
+void DvbDevice::autoTune(const DvbTransponder &transponder, const QList<DvbTransponder> &hints)
 {
 	DvbTransponderBase::TransmissionType transmissionType = transponder.getTransmissionType();
 
 	autoTransponder = transponder;
+	autoCandidates.clear();
+	autoCandidateIndex = 0;
+	autoSignalSeen = false;
 
 	if (transmissionType == DvbTransponderBase::DvbT) {
-		DvbTTransponder *autoTTransponder = autoTransponder.as<DvbTTransponder>();
 		capabilities = backend->getCapabilities();
 
 		// we have to iterate over unsupported AUTO values
+		updateAutoCandidates(hints);
+		autoTransponder = autoCandidates.at(0);
 
-		if ((capabilities & DvbTFecAuto) == 0) {
-			autoTTransponder->fecRateHigh = DvbTTransponder::Fec2_3;
-		}
-
-		if ((capabilities & DvbTGuardIntervalAuto) == 0) {
-			autoTTransponder->guardInterval = DvbTTransponder::GuardInterval1_8;
-		}
-
-		if ((capabilities & DvbTModulationAuto) == 0) {
-			autoTTransponder->modulation = DvbTTransponder::Qam64;
-		}
-
-		if ((capabilities & DvbTTransmissionModeAuto) == 0) {
-			autoTTransponder->transmissionMode = DvbTTransponder::TransmissionMode8k;
+		if (autoCandidates.size() > 1) {
+			qCDebug(logDvb, "trying up to %d parameter sets", autoCandidates.size());
 		}
-		isAuto = true;
-		tune(autoTransponder);
 	} else if (transmissionType == DvbTransponderBase::DvbT2) {
 		// I guess all DVB-T2 devices support auto-detection
-		isAuto = true;
-		tune(autoTransponder);
 	} else if (transmissionType == DvbTransponderBase::IsdbT) {
 		// ISDB-T Currently, all ISDB-T tuners should support auto mode
-		isAuto = true;
-		tune(autoTransponder);
 	} else {
 		qCWarning(logDev, "Can't do auto-tune for %d", transmissionType);
 		return;
@@ -446,6 +787,96 @@ void DvbDevice::autoTune(const DvbTransponder &transponder)
 	tune(autoTransponder);
 }
 
+void DvbDevice::updateAutoCandidates(const QList<DvbTransponder> &hints)
+{
+	QList<DvbTTransponder::FecRate> fecRates;
+	QList<DvbTTransponder::GuardInterval> guardIntervals;
+	QList<DvbTTransponder::Modulation> modulations;
+	QList<DvbTTransponder::TransmissionMode> transmissionModes;
+	const DvbTTransponder *dvbTTransponder = autoTransponder.as<DvbTTransponder>();
+
+	if ((capabilities & DvbTFecAuto) == 0) {
+		fecRates << DvbTTransponder::Fec2_3 << DvbTTransponder::Fec3_4 <<
+			DvbTTransponder::Fec1_2 << DvbTTransponder::Fec5_6 << DvbTTransponder::Fec7_8;
+	} else {
+		fecRates << dvbTTransponder->fecRateHigh;
+	}
+
+	if ((capabilities & DvbTGuardIntervalAuto) == 0) {
+		guardIntervals << DvbTTransponder::GuardInterval1_8 <<
+			DvbTTransponder::GuardInterval1_32 << DvbTTransponder::GuardInterval1_4 <<
+			DvbTTransponder::GuardInterval1_16;
+	} else {
+		guardIntervals << dvbTTransponder->guardInterval;
+	}
+
+	if ((capabilities & DvbTModulationAuto) == 0) {
+		modulations << DvbTTransponder::Qam64 << DvbTTransponder::Qam16 <<
+			DvbTTransponder::Qpsk;
+	} else {
+		modulations << dvbTTransponder->modulation;
+	}
+
+	// 4k is left out so that clearly no compatibility problem arises
+	if ((capabilities & DvbTTransmissionModeAuto) == 0) {
+		transmissionModes << DvbTTransponder::TransmissionMode8k <<
+			DvbTTransponder::TransmissionMode2k;
+	} else {
+		transmissionModes << dvbTTransponder->transmissionMode;
+	}
+
+	/*
+	 * the parameter sets are tried in the order of the first matching hint (the
+	 * hints are sorted by likelihood); the remaining ones keep the default order
+	 */
+
+	QList<DvbTransponder> candidates;
+	QList<QPair<int, int> > ranks;
+
+	foreach (DvbTTransponder::TransmissionMode transmissionMode, transmissionModes) {
+		foreach (DvbTTransponder::Modulation modulation, modulations) {
+			foreach (DvbTTransponder::GuardInterval guardInterval, guardIntervals) {
+				foreach (DvbTTransponder::FecRate fecRate, fecRates) {
+					DvbTransponder candidate = autoTransponder;
+					DvbTTransponder *candidateT = candidate.as<DvbTTransponder>();
+					candidateT->fecRateHigh = fecRate;
+					candidateT->guardInterval = guardInterval;
+					candidateT->modulation = modulation;
+					candidateT->transmissionMode = transmissionMode;
+					int rank = hints.size();
+
+					for (int i = 0; i < hints.size(); ++i) {
+						const DvbTTransponder *hint =
+							hints.at(i).as<DvbTTransponder>();
+
+						if ((hint != NULL) &&
+						    (((capabilities & DvbTFecAuto) != 0) ||
+						     (hint->fecRateHigh == fecRate)) &&
+						    (((capabilities & DvbTGuardIntervalAuto) != 0) ||
+						     (hint->guardInterval == guardInterval)) &&
+						    (((capabilities & DvbTModulationAuto) != 0) ||
+						     (hint->modulation == modulation)) &&
+						    (((capabilities & DvbTTransmissionModeAuto) != 0) ||
+						     (hint->transmissionMode == transmissionMode))) {
+							rank = i;
+							break;
+						}
+					}
+
+					ranks.append(qMakePair(rank, candidates.size()));
+					candidates.append(candidate);
+				}
+			}
+		}
+	}
+
+	qSort(ranks);
+
+	for (int i = 0; i < ranks.size(); ++i) {
+		autoCandidates.append(candidates.at(ranks.at(i).second));
+	}
+}
+
 bool DvbDevice::addPidFilter(int pid, DvbPidFilter *filter)
 {
 	QMap<int, DvbFilterInternal>::iterator it = filters.find(pid);
@@ -458,13 +889,6 @@ bool DvbDevice::addPidFilter(int pid, DvbPidFilter *filter)
 		}
 	}
 
-	if (it->activeFilters == 0) {
-		if (!backend->addPidFilter(pid)) {
-			cleanUpFilters = true;
-			return false;
-		}
-	}
-
 	if (it->filters.contains(filter)) {
 		qCInfo(logDev, "Using the same filter for the same pid more than once");
 		return true;
@@ -472,24 +896,52 @@ bool DvbDevice::addPidFilter(int pid, DvbPidFilter *filter)
 
 	it->filters.append(filter);
 	++it->activeFilters;
+
+	if ((it->activeFilters == 1) && !updateBackendPids()) {
+		filters.erase(it);
+		updateBackendPids();
+		return false;
+	}
+
+	updateFilterTable();
 	return true;
 }
 
 bool DvbDevice::addSectionFilter(int pid, DvbSectionFilter *filter)
+{
+	return addSectionFilter(pid, filter, false);
+}
+
+bool DvbDevice::addSectionFilter(int pid, DvbSectionFilter *filter, bool changedSectionsOnly)
 {
 	QMap<int, DvbSectionFilterInternal>::iterator it = sectionFilters.find(pid);
 
 	if (it == sectionFilters.end()) {
 		it = sectionFilters.insert(pid, DvbSectionFilterInternal());
+		it->device = this;
+		it->pid = pid;
 	}
 
 	if (it->activeSectionFilters == 0) {
-		if (!addPidFilter(pid, &(*it))) {
-			cleanUpFilters = true;
+		it->kernelFilter = (kernelSectionFilters && backend->addSectionFilter(pid));
+
+		if (!it->kernelFilter && !addPidFilter(pid, &(*it))) {
+			cleanUpSectionFilters = true;
 			return false;
 		}
 	}
 
+	if (changedSectionsOnly) {
+		DvbChangedSectionFilter *changedSectionFilter = findChangedSectionFilter(pid, filter);
+
+		if (changedSectionFilter == NULL) {
+			changedSectionFilter = new DvbChangedSectionFilter(pid, filter);
+			changedSectionFilters.append(changedSectionFilter);
+		}
+
+		filter = changedSectionFilter;
+	}
+
 	if (it->sectionFilters.contains(filter)) {
 		qCInfo(logDev, "Using the same filter for the same pid more than once");
 		return true;
@@ -516,14 +968,15 @@ void DvbDevice::removePidFilter(int pid, DvbPidFilter *filter)
 		return;
 	}
 
-	it->filters.replace(index, &dummyPidFilter);
+	it->filters.removeAt(index);
 	--it->activeFilters;
 
 	if (it->activeFilters == 0) {
-		backend->removePidFilter(pid);
+		filters.erase(it);
+		updateBackendPids();
 	}
 
-	cleanUpFilters = true;
+	updateFilterTable();
 }
 
 void DvbDevice::removeSectionFilter(int pid, DvbSectionFilter *filter)
@@ -533,6 +986,14 @@ void DvbDevice::removeSectionFilter(int pid, DvbSectionFilter *filter)
 
 	if (it != sectionFilters.end()) {
 		index = it->sectionFilters.indexOf(filter);
+
+		if (index < 0) {
+			DvbChangedSectionFilter *changedSectionFilter = findChangedSectionFilter(pid, filter);
+
+			if (changedSectionFilter != NULL) {
+				index = it->sectionFilters.indexOf(changedSectionFilter);
+			}
+		}
 	} else {
 		index = -1;
 	}
@@ -542,14 +1003,41 @@ void DvbDevice::removeSectionFilter(int pid, DvbSectionFilter *filter)
 		return;
 	}
 
+	for (int i = 0; i < changedSectionFilters.size(); ++i) {
+		DvbChangedSectionFilter *changedSectionFilter = changedSectionFilters.at(i);
+
+		if (changedSectionFilter == it->sectionFilters.at(index)) {
+			// the filter may be in use; it's deleted in customEvent()
+			changedSectionFilter->filter = NULL;
+			obsoleteChangedSectionFilters.append(changedSectionFilter);
+			changedSectionFilters.removeAt(i);
+			break;
+		}
+	}
+
 	it->sectionFilters.replace(index, &dummySectionFilter);
 	--it->activeSectionFilters;
 
 	if (it->activeSectionFilters == 0) {
-		removePidFilter(pid, &(*it));
+		if (it->kernelFilter) {
+			backend->removeSectionFilter(pid);
+		} else {
+			removePidFilter(pid, &(*it));
+		}
 	}
 
-	cleanUpFilters = true;
+	cleanUpSectionFilters = true;
+}
+
+DvbChangedSectionFilter *DvbDevice::findChangedSectionFilter(int pid, DvbSectionFilter *filter)
+{
+	foreach (DvbChangedSectionFilter *changedSectionFilter, changedSectionFilters) {
+		if ((changedSectionFilter->pid == pid) && (changedSectionFilter->filter == filter)) {
+			return changedSectionFilter;
+		}
+	}
+
+	return NULL;
 }
 
 void DvbDevice::startDescrambling(const QByteArray &pmtSectionData, QObject *user)
@@ -619,11 +1107,139 @@ DvbTransponder DvbDevice::getAutoTransponder() const
 	return autoTransponder;
 }
 
+DvbDeviceStatistics DvbDevice::getStatistics()
+{
+	DvbDeviceStatistics statistics;
+	collectStatistics(statistics, false);
+
+	// the rates and maxima belong to the last statistics interval
+	statistics.total.bitRate = lastStatistics.total.bitRate;
+
+	for (QMap<int, DvbPidStatistics>::iterator it = statistics.pids.begin();
+	     it != statistics.pids.end(); ++it) {
+		it->bitRate = lastStatistics.pids.value(it.key()).bitRate;
+	}
+
+	statistics.bufferFill = lastStatistics.bufferFill;
+	statistics.bufferLatency = lastStatistics.bufferLatency;
+	statistics.sectionLatency = lastStatistics.sectionLatency;
+	return statistics;
+}
+
+void DvbDevice::collectStatistics(DvbDeviceStatistics &statistics, bool resetMaxima)
+{
+	filterMutex.lock();
+
+	for (int pid = 0; pid <= 0x1fff; ++pid) {
+		if ((counters->packets[pid] == 0) && (counters->teiPackets[pid] == 0)) {
+			continue;
+		}
+
+		DvbPidStatistics &pidStatistics = statistics.pids[pid];
+		pidStatistics.packets = counters->packets[pid];
+		pidStatistics.ccErrors = counters->ccErrors[pid];
+		pidStatistics.teiPackets = counters->teiPackets[pid];
+		pidStatistics.crcErrors = counters->crcErrors[pid];
+	}
+
+	statistics.bufferFill = counters->maximumUsedSize;
+
+	if (resetMaxima) {
+		counters->maximumUsedSize = 0;
+	}
+
+	filterMutex.unlock();
+
+	sectionMutex.lock();
+	statistics.sectionLatency = sectionLatency;
+
+	if (resetMaxima) {
+		sectionLatency = 0;
+	}
+
+	sectionMutex.unlock();
+
+	for (QMap<int, int>::ConstIterator it = sectionCounts.constBegin();
+	     it != sectionCounts.constEnd(); ++it) {
+		statistics.pids[it.key()].sections = it.value();
+	}
+
+	foreach (const DvbPidStatistics &pidStatistics, statistics.pids) {
+		statistics.total.packets += pidStatistics.packets;
+		statistics.total.ccErrors += pidStatistics.ccErrors;
+		statistics.total.teiPackets += pidStatistics.teiPackets;
+		statistics.total.crcErrors += pidStatistics.crcErrors;
+		statistics.total.sections += pidStatistics.sections;
+	}
+
+	statisticsMutex.lock();
+	statistics.overflowCount = overflowCount;
+	statistics.lostBytes = lostBytes;
+	statisticsMutex.unlock();
+
+	statistics.bufferSize = dataBuffer->getSize();
+}
+
+void DvbDevice::updateStatistics()
+{
+	DvbDeviceStatistics statistics;
+	collectStatistics(statistics, true);
+	qint64 interval = qMax(statisticsInterval.restart(), Q_INT64_C(1)); // ms
+
+	for (QMap<int, DvbPidStatistics>::iterator it = statistics.pids.begin();
+	     it != statistics.pids.end(); ++it) {
+		qint64 packets = (it->packets - lastStatistics.pids.value(it.key()).packets);
+		it->bitRate = int((qMax(packets, Q_INT64_C(0)) * 188 * 8 * 1000) / interval);
+	}
+
+	qint64 packets = (statistics.total.packets - lastStatistics.total.packets);
+	statistics.total.bitRate = int((qMax(packets, Q_INT64_C(0)) * 188 * 8 * 1000) / interval);
+
+	if (statistics.total.bitRate > 0) {
+		statistics.bufferLatency = int((qint64(statistics.bufferFill) * 8 * 1000) /
+			statistics.total.bitRate);
+	}
+
+	int ccErrors = (statistics.total.ccErrors - lastStatistics.total.ccErrors);
+	int teiPackets = (statistics.total.teiPackets - lastStatistics.total.teiPackets);
+	int crcErrors = (statistics.total.crcErrors - lastStatistics.total.crcErrors);
+	int overflows = (statistics.overflowCount - lastStatistics.overflowCount);
+
+	if ((ccErrors > 0) || (teiPackets > 0) || (crcErrors > 0) || (overflows > 0)) {
+		qCWarning(logDev, "Stream errors on %s: %d cc errors, %d tei packets, %d crc errors, %d overflows",
+			qPrintable(getFrontendName()), ccErrors, teiPackets, crcErrors, overflows);
+	}
+
+	if (deviceState == DeviceTuned) {
+		qCDebug(logDev, "Statistics of %s: %.2f Mbit/s, %d pids, %d sections, buffer %d of %d bytes (%d ms), section latency %d ms",
+			qPrintable(getFrontendName()), statistics.total.bitRate / 1000000.0,
+			statistics.pids.size(), statistics.total.sections - lastStatistics.total.sections,
+			statistics.bufferFill, statistics.bufferSize, statistics.bufferLatency,
+			statistics.sectionLatency);
+	}
+
+	lastStatistics = statistics;
+}
+
 bool DvbDevice::acquire(const DvbConfigBase *config_)
 {
 	Q_ASSERT(deviceState == DeviceReleased);
 
+	// the backend doesn't deliver data while the device is released
+	dataBuffer->resize(dataBufferSize);
+	counters->reset();
+	sectionCounts.clear();
+	lastStatistics = DvbDeviceStatistics();
+
+	statisticsMutex.lock();
+	overflowCount = 0;
+	lostBytes = 0;
+	statisticsMutex.unlock();
+
 	if (backend->acquire()) {
+		startDemux();
+		statisticsInterval.start();
+		statisticsTimer.start();
 		config = config_;
 		setDeviceState(DeviceIdle);
 		autoTransponder.setTransmissionType(DvbTransponderBase::Invalid);
@@ -645,9 +1261,13 @@ void DvbDevice::reacquire(const DvbConfigBase *config_)
 
 void DvbDevice::release()
 {
+	statisticsTimer.stop();
 	setDeviceState(DeviceReleased);
 	stop();
 	backend->release();
+	backendPids.clear();
+	pidFilterLimit = -1;
+	stopDemux();
 }
 
 void DvbDevice::enableDvbDump()
@@ -665,28 +1285,76 @@ void DvbDevice::enableDvbDump()
 		it->filters.append(dataDumper);
 	}
 
+	updateFilterTable();
 	backend->enableDvbDump();
 }
 
+void DvbDevice::setDataBufferSize(int size)
+{
+	dataBufferSize = size;
+}
+
+void DvbDevice::setKernelSectionFilters(bool enabled)
+{
+	kernelSectionFilters = enabled;
+}
+
+void DvbDevice::setFullTsThreshold(int threshold)
+{
+	fullTsThreshold = threshold;
+	updateBackendPids();
+}
+
 void DvbDevice::frontendEvent()
 {
 	DvbTransponderBase::TransmissionType transmissionType = autoTransponder.getTransmissionType();
 
-	if (backend->isTuned()) {
-		qCDebug(logDvb, "tuning succeeded on %.2f MHz", backend->getFrqMHz());
+	// backends reporting the status signal the lock themselves; otherwise poll
+	if ((!frontendStatusReported ||
+	     ((frontendStatus.loadAcquire() & DvbBackendDevice::HasLock) != 0)) &&
+	    backend->isTuned()) {
+		qCDebug(logDvb, "tuning succeeded on %.2f MHz after %lld ms", backend->getFrqMHz(),
+			tuningTimer.elapsed());
 		frontendTimer.stop();
+		lockTimestamp = (tuningTimer.msecsSinceReference() + tuningTimer.elapsed());
 		backend->getProps(autoTransponder);
+
+		if (deviceState == DeviceRotorMoving) {
+			// the rotor has arrived
+			rotorMovementTime = 0;
+		}
+
 		setDeviceState(DeviceTuned);
 		return;
 	}
 
 	// FIXME progress bar when moving rotor
 
-	frontendTimeout -= 100;
+	int elapsed = int(tuningTimer.elapsed());
+	bool timedOut = (elapsed >= frontendTimeout);
 
-	if (frontendTimeout <= 0) {
+	// there's no point in waiting the full timeout if there isn't even a signal; while
+	// trying dvb-t parameters, the carrier has to be found as well (once there's a signal)
+	int progressMask = ~0;
+
+	if (isAuto && autoSignalSeen) {
+		progressMask = ~int(DvbBackendDevice::HasSignal);
+	}
+
+	if (!timedOut && (deviceState == DeviceTuning) && frontendStatusReported &&
+	    ((seenFrontendStatus & progressMask) == 0) &&
+	    (elapsed >= qMax(1000, frontendTimeout / 2))) {
+		qCDebug(logDvb, "no signal on %.2f MHz after %d ms", backend->getFrqMHz(), elapsed);
+		timedOut = true;
+	}
+
+	if (timedOut) {
 		frontendTimer.stop();
 
+		// the rotor may not have reached its position; the command is sent again next time
+		lastRotorCommand.clear();
+		rotorPositionKnown = false;
+
 		if (!isAuto) {
 			qCDebug(logDvb, "tuning failed on %.2f MHz", backend->getFrqMHz());
 			setDeviceState(DeviceIdle);
@@ -694,16 +1362,12 @@ void DvbDevice::frontendEvent()
 			return;
 		}
 
-		bool carry = true;
-
 		/*
 		 * As ISDB-T always support auto-scan, we only need to simulate
 		 * it for DVB-T
 		 */
 		if (transmissionType == DvbTransponderBase::DvbT) {
 			DvbBackendDevice::Scale scale;
-
-			DvbTTransponder *autoTTransponder = autoTransponder.as<DvbTTransponder>();
 			float signal = backend->getSignal(scale);
 
 			if ((scale != DvbBackendDevice::NotSupported) && (signal < 15)) {
@@ -716,111 +1380,66 @@ void DvbDevice::frontendEvent()
 			 * indicator of the quality. Better to just print a
 			 * warning, and not fail.
 			 */
-#if 0
-				setDeviceState(DeviceIdle);
-				autoTransponder.setTransmissionType(DvbTransponderBase::Invalid);
-				return;
-#endif
 			}
 
-			if (carry && ((capabilities & DvbTFecAuto) == 0)) {
-				switch (autoTTransponder->fecRateHigh) {
-				case DvbTTransponder::Fec2_3:
-					autoTTransponder->fecRateHigh = DvbTTransponder::Fec3_4;
-					carry = false;
-					break;
-				case DvbTTransponder::Fec3_4:
-					autoTTransponder->fecRateHigh = DvbTTransponder::Fec1_2;
-					carry = false;
-					break;
-				case DvbTTransponder::Fec1_2:
-					autoTTransponder->fecRateHigh = DvbTTransponder::Fec5_6;
-					carry = false;
-					break;
-				case DvbTTransponder::Fec5_6:
-					autoTTransponder->fecRateHigh = DvbTTransponder::Fec7_8;
-					carry = false;
-					break;
-				default:
-					autoTTransponder->fecRateHigh = DvbTTransponder::Fec2_3;
-					break;
-				}
-			}
+			if (frontendStatusReported) {
+				autoSignalSeen = (autoSignalSeen || (seenFrontendStatus != 0));
 
-			if (carry && ((capabilities & DvbTGuardIntervalAuto) == 0)) {
-				switch (autoTTransponder->guardInterval) {
-				case DvbTTransponder::GuardInterval1_8:
-					autoTTransponder->guardInterval =
-						DvbTTransponder::GuardInterval1_32;
-					carry = false;
-					break;
-				case DvbTTransponder::GuardInterval1_32:
-					autoTTransponder->guardInterval =
-						DvbTTransponder::GuardInterval1_4;
-					carry = false;
-					break;
-				case DvbTTransponder::GuardInterval1_4:
-					autoTTransponder->guardInterval =
-						DvbTTransponder::GuardInterval1_16;
-					carry = false;
-					break;
-				case DvbTTransponder::GuardInterval1_16:
-				case DvbTTransponder::GuardIntervalAuto:
-					autoTTransponder->guardInterval =
-						DvbTTransponder::GuardInterval1_8;
-					break;
+				// the parameters can't make up for a missing signal
+				if (!autoSignalSeen) {
+					autoCandidateIndex = autoCandidates.size();
 				}
 			}
 
-			if (carry && ((capabilities & DvbTModulationAuto) == 0)) {
-				switch (autoTTransponder->modulation) {
-				case DvbTTransponder::Qam64:
-					autoTTransponder->modulation = DvbTTransponder::Qam16;
-					carry = false;
-					break;
-				case DvbTTransponder::Qam16:
-					autoTTransponder->modulation = DvbTTransponder::Qpsk;
-					carry = false;
-					break;
-				case DvbTTransponder::Qpsk:
-				case DvbTTransponder::ModulationAuto:
-					autoTTransponder->modulation = DvbTTransponder::Qam64;
-					break;
-				}
-			}
+			++autoCandidateIndex;
 
-			if (carry && ((capabilities & DvbTTransmissionModeAuto) == 0)) {
-				switch (autoTTransponder->transmissionMode) {
-				case DvbTTransponder::TransmissionMode8k:
-					autoTTransponder->transmissionMode =
-						DvbTTransponder::TransmissionMode2k;
-					carry = false;
-					break;
-				case DvbTTransponder::TransmissionMode2k:
-	/* outcommented so that clearly no compatibility problem arises
-					autoTTransponder->transmissionMode =
-						DvbTTransponder::TransmissionMode4k;
-					carry = false;
-					break;
-	*/
-				case DvbTTransponder::TransmissionMode4k:
-				case DvbTTransponder::TransmissionModeAuto:
-					autoTTransponder->transmissionMode =
-						DvbTTransponder::TransmissionMode8k;
-					break;
-				}
+			if (autoCandidateIndex < autoCandidates.size()) {
+				autoTransponder = autoCandidates.at(autoCandidateIndex);
+				tune(autoTransponder);
+				return;
 			}
 		}
 
-		if (!carry) {
-			tune(autoTransponder);
-		} else {
-			qCDebug(logDvb, "tuning failed on %.2f MHz", backend->getFrqMHz());;
-			setDeviceState(DeviceIdle);
-		}
+		qCDebug(logDvb, "tuning failed on %.2f MHz", backend->getFrqMHz());
+		setDeviceState(DeviceIdle);
+	}
+}
+
+void DvbDevice::frontendStatusChanged()
+{
+	frontendStatusQueued.storeRelease(0);
+	int status = frontendStatus.loadAcquire();
+
+	if (!frontendTimer.isActive()) {
+		return;
+	}
+
+	// a report may still stem from the previous tune; a lock is verified anyway
+	frontendStatusReported = true;
+	seenFrontendStatus |= status;
+
+	if ((status & DvbBackendDevice::HasLock) != 0) {
+		frontendEvent();
 	}
 }
 
+void DvbDevice::diseqcEvent()
+{
+	if (!pendingRotorCommand.isEmpty()) {
+		backend->sendMessage(pendingRotorCommand.constData(), pendingRotorCommand.size());
+		lastRotorCommand = pendingRotorCommand;
+		pendingRotorCommand.clear();
+		rotorPosition = pendingRotorPosition;
+		rotorPositionKnown = (config->configuration == DvbConfigBase::UsalsRotor);
+		rotorMovementTime = pendingRotorTimeout;
+		rotorMovementTimer.start();
+		diseqcTimer.start(15);
+		return;
+	}
+
+	tuneBackend(pendingTransponder, pendingRotorTimeout);
+}
+
 void DvbDevice::setDeviceState(DeviceState newState)
 {
 	if (deviceState != newState) {
@@ -829,33 +1448,71 @@ void DvbDevice::setDeviceState(DeviceState newState)
 	}
 }
 
-void DvbDevice::discardBuffers()
+void DvbDevice::tuneBackend(const DvbTransponder &transponder, int rotorTimeout)
 {
-	dataChannelMutex.lock();
-
-	if (usedBuffersHead != NULL) {
-		usedBuffersHead->size = 0;
-		DvbDeviceDataBuffer *nextBuffer = usedBuffersHead->next;
-		usedBuffersHead->next = NULL;
+	// the hardware may behave differently after tuning; try the pid filters again
+	pidFilterLimit = -1;
 
-		if (nextBuffer != NULL) {
-			nextBuffer->next = unusedBuffersHead;
-			unusedBuffersHead = nextBuffer;
+	if (backend->tune(transponder)) {
+		if (rotorTimeout <= 0) {
+			setDeviceState(DeviceTuning);
+			startFrontendTimer(config->timeout);
+		} else {
+			setDeviceState(DeviceRotorMoving);
+			startFrontendTimer(rotorTimeout);
 		}
+
+		discardBuffers();
+	} else {
+		setDeviceState(DeviceTuning);
+		setDeviceState(DeviceIdle);
+		autoTransponder.setTransmissionType(DvbTransponderBase::Invalid);
+	}
+}
+
+void DvbDevice::startFrontendTimer(int timeout)
+{
+	frontendTimeout = timeout;
+	frontendStatusReported = false;
+	seenFrontendStatus = 0;
+	tuningTimer.start();
+	tuneTimestamp = tuningTimer.msecsSinceReference();
+	lockTimestamp = -1;
+	frontendTimer.start(100);
+}
+
+void DvbDevice::discardBuffers()
+{
+	// the demux thread drops the data which has been buffered until now; a request
+	// which is handled late (after another retune) doesn't affect the newer data
+	sectionMutex.lock();
+	discardPosition.storeRelease(dataBuffer->getCommittedBytes());
+	discardGeneration.ref();
+	pendingSections.clear();
+	sectionMutex.unlock();
+
+	// the sections of the new transponder are unrelated
+	foreach (DvbChangedSectionFilter *changedSectionFilter, changedSectionFilters) {
+		changedSectionFilter->reset();
 	}
 
-	dataChannelMutex.unlock();
+	dataMutex.lock();
+	dataAvailable.wakeOne();
+	dataMutex.unlock();
 }
 
 void DvbDevice::stop()
 {
 	isAuto = false;
 	frontendTimer.stop();
+	diseqcTimer.stop();
 
-	for (QMap<int, DvbFilterInternal>::ConstIterator it = filters.constBegin();
-	     it != filters.constEnd(); ++it) {
+	QMap<int, DvbFilterInternal> pendingFilters = filters;
+
+	for (QMap<int, DvbFilterInternal>::ConstIterator it = pendingFilters.constBegin();
+	     it != pendingFilters.constEnd(); ++it) {
 		foreach (DvbPidFilter *filter, it->filters) {
-			if ((filter != &dummyPidFilter) && (filter != dataDumper)) {
+			if (filter != dataDumper) {
 				int pid = it.key();
 				qCDebug(logDvb, "removing pending filter %d", pid);
 				removePidFilter(pid, filter);
@@ -875,129 +1532,291 @@ void DvbDevice::stop()
 	}
 }
 
-DvbDataBuffer DvbDevice::getBuffer()
+void DvbDevice::startDemux()
 {
-	dataChannelMutex.lock();
-	DvbDeviceDataBuffer *buffer = unusedBuffersHead;
+	dataMutex.lock();
+	demuxStopped = false;
+	dataMutex.unlock();
 
-	if (buffer != NULL) {
-		unusedBuffersHead = buffer->next;
-		dataChannelMutex.unlock();
-	} else {
-		dataChannelMutex.unlock();
-		buffer = new DvbDeviceDataBuffer;
-	}
-
-	return DvbDataBuffer(buffer->data, sizeof(buffer->data));
+	handledDiscardGeneration.storeRelease(discardGeneration.loadAcquire());
+	demuxThread->start();
 }
 
-void DvbDevice::writeBuffer(const DvbDataBuffer &dataBuffer)
+void DvbDevice::stopDemux()
 {
-	DvbDeviceDataBuffer *buffer = reinterpret_cast<DvbDeviceDataBuffer *>(dataBuffer.data);
-	Q_ASSERT(buffer->data == dataBuffer.data);
+	dataMutex.lock();
+	demuxStopped = true;
+	dataAvailable.wakeOne();
+	dataMutex.unlock();
 
-	if (dataBuffer.dataSize > 0) {
-		buffer->size = dataBuffer.dataSize;
-		dataChannelMutex.lock();
-		bool wakeUp = false;
+	demuxThread->wait();
 
-		if (usedBuffersHead != NULL) {
-			usedBuffersTail->next = buffer;
-		} else {
-			usedBuffersHead = buffer;
-			wakeUp = true;
-		}
+	sectionMutex.lock();
+	pendingSections.clear();
+	sectionMutex.unlock();
+}
 
-		usedBuffersTail = buffer;
-		usedBuffersTail->next = NULL;
-		dataChannelMutex.unlock();
+bool DvbDevice::updateBackendPids()
+{
+	QSet<int> pids;
 
-		if (wakeUp) {
-			QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+	for (QMap<int, DvbFilterInternal>::ConstIterator it = filters.constBegin();
+	     it != filters.constEnd(); ++it) {
+		if (it->activeFilters > 0) {
+			pids.insert(it.key());
 		}
-	} else {
-		dataChannelMutex.lock();
-		buffer->next = unusedBuffersHead;
-		unusedBuffersHead = buffer;
-		dataChannelMutex.unlock();
 	}
-}
 
-void DvbDevice::customEvent(QEvent *)
-{
-	if (cleanUpFilters) {
-		cleanUpFilters = false;
+	// switch back only well below the threshold to avoid toggling
+	bool fullTs = backendPids.contains(0x2000);
+	int threshold = (fullTs ? ((fullTsThreshold * 3) / 4) : fullTsThreshold);
+	fullTs = (pids.contains(0x2000) || ((fullTsThreshold > 0) && (pids.size() > threshold)) ||
+		((pidFilterLimit >= 0) && (pids.size() > pidFilterLimit)));
 
-		{
-			QMap<int, DvbFilterInternal>::iterator it = filters.begin();
-			QMap<int, DvbFilterInternal>::iterator end = filters.end();
-
-			while (it != end) {
-				if (it->activeFilters == 0) {
-					it = filters.erase(it);
+	while (true) {
+		QSet<int> wantedPids = (fullTs ? (QSet<int>() << 0x2000) : pids);
+		bool ok = true;
+
+		// add the new filters first, so that no data is lost while switching
+		foreach (int pid, wantedPids) {
+			if (!backendPids.contains(pid)) {
+				if (backend->addPidFilter(pid)) {
+					backendPids.insert(pid);
 				} else {
-					it->filters.removeAll(&dummyPidFilter);
-					++it;
+					ok = false;
 				}
 			}
 		}
 
-		{
-			QMap<int, DvbSectionFilterInternal>::iterator it = sectionFilters.begin();
-			QMap<int, DvbSectionFilterInternal>::iterator end = sectionFilters.end();
+		if (!ok && !fullTs && !pids.isEmpty()) {
+			// e.g. the hardware pid filters are exhausted; remember how many worked, so
+			// that the next filter change doesn't try again
+			pidFilterLimit = 0;
 
-			while (it != end) {
-				if (it->activeSectionFilters == 0) {
-					it = sectionFilters.erase(it);
-				} else {
-					it->sectionFilters.removeAll(&dummySectionFilter);
-					++it;
+			foreach (int pid, wantedPids) {
+				if (backendPids.contains(pid)) {
+					++pidFilterLimit;
 				}
 			}
+
+			qCInfo(logDev, "Cannot set up more than %d pid filters, receiving the whole transponder",
+				pidFilterLimit);
+			fullTs = true;
+			continue;
 		}
+
+		foreach (int pid, backendPids) {
+			if (!wantedPids.contains(pid)) {
+				backend->removePidFilter(pid);
+				backendPids.remove(pid);
+			}
+		}
+
+		return ok;
 	}
+}
 
-	DvbDeviceDataBuffer *buffer = NULL;
+void DvbDevice::updateFilterTable()
+{
+	DvbPidFilterTable *newFilterTable = new DvbPidFilterTable(filters);
 
-	while (true) {
-		dataChannelMutex.lock();
+	// the old table may still be in use until filterMutex can be acquired
+	filterMutex.lock();
+	qSwap(filterTable, newFilterTable);
+	filterMutex.unlock();
+
+	delete newFilterTable;
+}
+
+DvbDataBuffer DvbDevice::getBuffer()
+{
+	DvbDataBuffer buffer(dataBuffer->getWritePointer(), dataBuffer->getWritableSize());
+	buffer.dataSize = 0;
+	return buffer;
+}
+
+void DvbDevice::writeBuffer(const DvbDataBuffer &buffer)
+{
+	if (buffer.dataSize > 0) {
+		Q_ASSERT(buffer.data == dataBuffer->getWritePointer());
 
-		if (buffer != NULL) {
-			usedBuffersHead = buffer->next;
-			buffer->next = unusedBuffersHead;
-			unusedBuffersHead = buffer;
+		if (dataBuffer->commit(buffer.dataSize)) {
+			dataMutex.lock();
+			dataAvailable.wakeOne();
+			dataMutex.unlock();
 		}
+	}
+}
+
+void DvbDevice::writeSection(int pid, const char *data, int size)
+{
+	queueSection(pid, data, size);
+}
+
+void DvbDevice::reportOverflow(int lostBytes_)
+{
+	QMutexLocker locker(&statisticsMutex);
+	++overflowCount;
+	lostBytes += lostBytes_;
+}
 
-		buffer = usedBuffersHead;
-		dataChannelMutex.unlock();
+void DvbDevice::reportFrontendStatus(int status)
+{
+	frontendStatus.storeRelease(status);
+
+	// only the latest status is of interest
+	if (frontendStatusQueued.testAndSetOrdered(0, 1)) {
+		QMetaObject::invokeMethod(this, "frontendStatusChanged", Qt::QueuedConnection);
+	}
+}
+
+void DvbDevice::demux()
+{
+	// filterMutex shouldn't be held for too long at once
+	const int maximumChunkSize = (DvbPidFilterTable::MaximumBatchSize * 188);
+
+	while (true) {
+		dataMutex.lock();
 
-		if (buffer == NULL) {
+		while (!demuxStopped && (dataBuffer->getReadableSize() <= 0) &&
+		       !isDiscardPending()) {
+			dataAvailable.wait(&dataMutex);
+		}
+
+		if (demuxStopped) {
+			dataMutex.unlock();
 			break;
 		}
 
-		for (int i = 0; i < buffer->size; i += 188) {
-			char *packet = (buffer->data + i);
+		dataMutex.unlock();
+
+		int generation = discardGeneration.loadAcquire();
+
+		if (generation != handledDiscardGeneration.loadAcquire()) {
+			// the position belongs to 'generation' or to a newer one
+			dataBuffer->discard(discardPosition.loadAcquire());
+			handledDiscardGeneration.storeRelease(generation);
+
+			// the continuity counters of the new transponder are unrelated
+			filterMutex.lock();
+			counters->resetContinuity();
+			filterMutex.unlock();
+			continue;
+		}
+
+		int size = qMin(dataBuffer->getReadableSize(), maximumChunkSize);
+		const char *data = dataBuffer->getReadPointer();
+		bool dataDiscarded = false;
+		filterMutex.lock();
+		counters->maximumUsedSize = qMax(counters->maximumUsedSize, dataBuffer->getUsedSize());
+
+		for (int i = 0; i < size; i += 188) {
+			const char *packet = (data + i);
+			int pid = ((static_cast<unsigned char>(packet[1]) << 8) |
+				static_cast<unsigned char>(packet[2])) & ((1 << 13) - 1);
 
 			if ((packet[1] & 0x80) != 0) {
 				// transport error indicator
+				++counters->teiPackets[pid];
 				continue;
 			}
 
-			int pid = ((static_cast<unsigned char>(packet[1]) << 8) |
-				static_cast<unsigned char>(packet[2])) & ((1 << 13) - 1);
-
-			QMap<int, DvbFilterInternal>::const_iterator it = filters.constFind(pid);
+			counters->addPacket(pid, packet);
+			filterTable->addPacket(pid, packet);
 
-			if (it == filters.constEnd()) {
-				continue;
+			if (isDiscardPending()) {
+				// the device has been retuned; the remaining data is obsolete
+				dataDiscarded = true;
+				break;
 			}
+		}
 
-			const QList<DvbPidFilter *> &pidFilters = it->filters;
-			int pidFiltersSize = pidFilters.size();
+		filterTable->processBatches();
+		filterMutex.unlock();
 
-			for (int j = 0; j < pidFiltersSize; ++j) {
-				pidFilters.at(j)->processData(packet);
+		if (!dataDiscarded) {
+			dataBuffer->consume(size);
+		}
+	}
+}
+
+void DvbDevice::queueSection(int pid, const char *data, int size)
+{
+	QMutexLocker locker(&sectionMutex);
+
+	if (isDiscardPending()) {
+		// the section belongs to the previous transponder
+		return;
+	}
+
+	bool wasEmpty = pendingSections.isEmpty();
+	char header[4] = { char(pid >> 8), char(pid & 0xff), char(size >> 8), char(size & 0xff) };
+	pendingSections.append(header, sizeof(header));
+	pendingSections.append(data, size);
+
+	if (wasEmpty) {
+		sectionQueueTimer.start();
+		QCoreApplication::postEvent(this, new QEvent(QEvent::User));
+	}
+}
+
+void DvbDevice::customEvent(QEvent *)
+{
+	if (cleanUpSectionFilters) {
+		cleanUpSectionFilters = false;
+
+		QMap<int, DvbSectionFilterInternal>::iterator it = sectionFilters.begin();
+		QMap<int, DvbSectionFilterInternal>::iterator end = sectionFilters.end();
+
+		while (it != end) {
+			if (it->activeSectionFilters == 0) {
+				it = sectionFilters.erase(it);
+			} else {
+				it->sectionFilters.removeAll(&dummySectionFilter);
+				++it;
 			}
 		}
+
+		qDeleteAll(obsoleteChangedSectionFilters);
+		obsoleteChangedSectionFilters.clear();
+	}
+
+	sectionMutex.lock();
+	QByteArray sections = pendingSections;
+	pendingSections.clear();
+	int generation = discardGeneration.loadAcquire();
+
+	if (!sections.isEmpty()) {
+		sectionLatency = qMax(sectionLatency, int(sectionQueueTimer.elapsed()));
+	}
+
+	sectionMutex.unlock();
+
+	const char *it = sections.constBegin();
+	const char *end = sections.constEnd();
+
+	while (it != end) {
+		int pid = ((static_cast<unsigned char>(it[0]) << 8) | static_cast<unsigned char>(it[1]));
+		int size = ((static_cast<unsigned char>(it[2]) << 8) | static_cast<unsigned char>(it[3]));
+		const char *section = (it + 4);
+		it = (section + size);
+
+		if (discardGeneration.loadAcquire() != generation) {
+			// a section filter retuned the device
+			break;
+		}
+
+		QMap<int, DvbSectionFilterInternal>::const_iterator filterIt = sectionFilters.constFind(pid);
+
+		if (filterIt == sectionFilters.constEnd()) {
+			continue;
+		}
+
+		++sectionCounts[pid];
+
+		// section filters may be added or removed while iterating
+		for (int i = 0; i < filterIt->sectionFilters.size(); ++i) {
+			filterIt->sectionFilters.at(i)->processSection(section, size);
+		}
 	}
 }
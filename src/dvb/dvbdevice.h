@@ -21,35 +21,70 @@
 #ifndef DVBDEVICE_H
 #define DVBDEVICE_H
 
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QExplicitlySharedDataPointer>
 #include <QMap>
 #include <QMutex>
+#include <QSet>
 #include <QTimer>
+#include <QWaitCondition>
 #include "dvbbackenddevice.h"
 #include "dvbtransponder.h"
 
+class DvbChangedSectionFilter;
 class DvbConfigBase;
 class DvbDataDumper;
+class DvbDemuxThread;
 class DvbDeviceDataBuffer;
 class DvbFilterInternal;
+class DvbPidFilterTable;
 class DvbSectionFilterInternal;
+class DvbStreamCounters;
 
-class DvbDummyPidFilter : public DvbPidFilter
+class DvbDummySectionFilter : public DvbSectionFilter
 {
 public:
-	DvbDummyPidFilter() { }
-	~DvbDummyPidFilter() { }
+	DvbDummySectionFilter() { }
+	~DvbDummySectionFilter() { }
 
-	void processData(const char [188]) { }
+	void processSection(const char *, int) { }
 };
 
-class DvbDummySectionFilter : public DvbSectionFilter
+class DvbPidStatistics
 {
 public:
-	DvbDummySectionFilter() { }
-	~DvbDummySectionFilter() { }
+	DvbPidStatistics() : packets(0), bitRate(0), ccErrors(0), teiPackets(0), crcErrors(0),
+		sections(0) { }
+	~DvbPidStatistics() { }
 
-	void processSection(const char *, int) { }
+	qint64 packets;
+	int bitRate; // bit/s; average of the last statistics interval
+	int ccErrors; // continuity counter errors
+	int teiPackets; // packets with the transport error indicator set (dropped)
+	int crcErrors; // only for sections which aren't filtered by the backend
+	int sections; // sections passed to the section filters
+};
+
+class DvbDeviceStatistics
+{
+public:
+	DvbDeviceStatistics() : overflowCount(0), lostBytes(0), bufferSize(0), bufferFill(0),
+		bufferLatency(0), sectionLatency(0) { }
+	~DvbDeviceStatistics() { }
+
+	DvbPidStatistics total;
+	QMap<int, DvbPidStatistics> pids; // only pids with packets or sections
+
+	// data lost because the kernel buffer overflowed
+	int overflowCount;
+	qint64 lostBytes;
+	int bufferSize; // bytes
+
+	// the following values are maxima of the last statistics interval
+	int bufferFill; // bytes
+	int bufferLatency; // ms; estimated from bufferFill and the bit rate
+	int sectionLatency; // ms; time until the main thread delivers a section
 };
 
 // FIXME make DvbDevice shared ...
@@ -91,8 +126,12 @@ public:
 
 	void tune(const DvbTransponder &transponder);
 	void autoTune(const DvbTransponder &transponder);
+	// hints are dvb-t transponders with likely parameters (most likely first)
+	void autoTune(const DvbTransponder &transponder, const QList<DvbTransponder> &hints);
 	bool addPidFilter(int pid, DvbPidFilter *filter);
 	bool addSectionFilter(int pid, DvbSectionFilter *filter);
+	// only passes new or changed sections and reports complete tables
+	bool addSectionFilter(int pid, DvbSectionFilter *filter, bool changedSectionsOnly);
 	void removePidFilter(int pid, DvbPidFilter *filter);
 	void removeSectionFilter(int pid, DvbSectionFilter *filter);
 	void startDescrambling(const QByteArray &pmtSectionData, QObject *user);
@@ -103,6 +142,21 @@ public:
 	float getSnr(DvbBackendDevice::Scale &scale) const;
 	DvbTransponder getAutoTransponder() const;
 
+	// counters since the device was acquired
+	DvbDeviceStatistics getStatistics();
+
+	// monotonic timestamps (see QElapsedTimer::msecsSinceReference()) of the last
+	// backend tune and of the following lock; -1 if there wasn't any
+	qint64 getTuneTimestamp() const
+	{
+		return tuneTimestamp;
+	}
+
+	qint64 getLockTimestamp() const
+	{
+		return lockTimestamp;
+	}
+
 	/*
 	 * management functions (must be only called by DvbManager)
 	 */
@@ -111,45 +165,131 @@ public:
 	void reacquire(const DvbConfigBase *config_);
 	void release();
 	void enableDvbDump();
+	void setDataBufferSize(int size); // bytes; applied on the next acquire()
+	void setKernelSectionFilters(bool enabled); // applied to new section filters
+	// receive the whole transponder above this number of pids (0 = never)
+	void setFullTsThreshold(int threshold);
 
 signals:
 	void stateChanged();
 
 private slots:
 	void frontendEvent();
+	void frontendStatusChanged();
+	void diseqcEvent();
+	void updateStatistics();
 
 private:
+	friend class DvbDemuxThread;
+	friend class DvbSectionFilterInternal;
+
 	void setDeviceState(DeviceState newState);
+	void tuneBackend(const DvbTransponder &transponder, int rotorTimeout); // 0 = not moving
+	void startFrontendTimer(int timeout);
+	void updateAutoCandidates(const QList<DvbTransponder> &hints);
 	void discardBuffers();
+
+	bool isDiscardPending() const
+	{
+		return (discardGeneration.loadAcquire() != handledDiscardGeneration.loadAcquire());
+	}
+
 	void stop();
+	void startDemux();
+	void stopDemux();
+	bool updateBackendPids();
+	void updateFilterTable();
+	DvbChangedSectionFilter *findChangedSectionFilter(int pid, DvbSectionFilter *filter);
+	void collectStatistics(DvbDeviceStatistics &statistics, bool resetMaxima);
 
-	void processData(const char data[188]);
 	DvbDataBuffer getBuffer();
-	void writeBuffer(const DvbDataBuffer &dataBuffer);
+	void writeBuffer(const DvbDataBuffer &buffer);
+	void writeSection(int pid, const char *data, int size);
+	void reportOverflow(int lostBytes);
+	void reportFrontendStatus(int status);
+	void demux(); // runs in the demux thread
+	void queueSection(int pid, const char *data, int size); // demux thread
 	void customEvent(QEvent *);
 
 	DvbBackendDevice *backend;
 	DeviceState deviceState;
 	QExplicitlySharedDataPointer<const DvbConfigBase> config;
 
-	int frontendTimeout;
+	int frontendTimeout; // ms since tuningTimer was started
 	QTimer frontendTimer;
+	QElapsedTimer tuningTimer;
+	qint64 tuneTimestamp;
+	qint64 lockTimestamp;
+	QAtomicInt frontendStatus; // set by the backend (possibly in another thread)
+	QAtomicInt frontendStatusQueued;
+	bool frontendStatusReported; // since the last tune
+	int seenFrontendStatus; // status flags reported since the last tune
+
+	// rotor commands are sent from diseqcTimer, so that tune() doesn't block
+	QTimer diseqcTimer;
+	QByteArray pendingRotorCommand;
+	double pendingRotorPosition; // degrees (usals only)
+	DvbTransponder pendingTransponder;
+	int pendingRotorTimeout; // ms
+	QByteArray lastRotorCommand; // empty = position unknown
+	QElapsedTimer rotorMovementTimer;
+	qint64 rotorMovementTime; // ms; estimated duration of the last movement
+	double rotorPosition; // degrees (usals only)
+	bool rotorPositionKnown;
 	QMap<int, DvbFilterInternal> filters;
 	QMap<int, DvbSectionFilterInternal> sectionFilters;
-	DvbDummyPidFilter dummyPidFilter;
 	DvbDummySectionFilter dummySectionFilter;
+	QList<DvbChangedSectionFilter *> changedSectionFilters;
+	QList<DvbChangedSectionFilter *> obsoleteChangedSectionFilters; // deleted in customEvent()
 	DvbDataDumper *dataDumper;
-	bool cleanUpFilters;
+	bool cleanUpSectionFilters;
+	bool kernelSectionFilters;
+	int fullTsThreshold;
+	int pidFilterLimit; // filters the hardware accepted before refusing one; -1 = unknown
+	QSet<int> backendPids; // pids of the filters set up in the backend (0x2000 = all)
 	QMultiMap<int, QObject *> descramblingServices;
 
 	bool isAuto;
 	DvbTransponder autoTransponder;
+	QList<DvbTransponder> autoCandidates; // dvb-t parameter sets which are tried in turn
+	int autoCandidateIndex;
+	bool autoSignalSeen;
 	Capabilities capabilities;
 
-	DvbDeviceDataBuffer *unusedBuffersHead;
-	DvbDeviceDataBuffer *usedBuffersHead;
-	DvbDeviceDataBuffer *usedBuffersTail;
-	QMutex dataChannelMutex;
+	/*
+	 * the pid filters are called in the demux thread; it uses filterTable,
+	 * which is rebuilt by the main thread whenever the filters change and
+	 * swapped while holding filterMutex; the demux thread holds filterMutex
+	 * while a chunk of data is dispatched, so that a filter isn't called
+	 * anymore once removePidFilter() returns; sections are collected by the
+	 * demux thread and passed to the section filters in the main thread
+	 */
+
+	DvbDeviceDataBuffer *dataBuffer;
+	int dataBufferSize;
+	DvbDemuxThread *demuxThread;
+	QMutex dataMutex;
+	QWaitCondition dataAvailable;
+	bool demuxStopped; // protected by dataMutex
+	QAtomicInt discardGeneration; // incremented by discardBuffers()
+	QAtomicInt handledDiscardGeneration; // updated by the demux thread
+	QAtomicInteger<qint64> discardPosition; // see DvbDeviceDataBuffer::getCommittedBytes()
+	QMutex filterMutex;
+	DvbPidFilterTable *filterTable; // protected by filterMutex
+	QMutex sectionMutex;
+	QByteArray pendingSections; // pid, size, section; protected by sectionMutex
+	QElapsedTimer sectionQueueTimer; // started when pendingSections becomes non-empty
+	int sectionLatency; // ms; protected by sectionMutex
+	DvbStreamCounters *counters; // protected by filterMutex
+	QMutex statisticsMutex;
+	int overflowCount; // protected by statisticsMutex
+	qint64 lostBytes; // protected by statisticsMutex
+
+	// only accessed by the main thread
+	QMap<int, int> sectionCounts;
+	QTimer statisticsTimer;
+	QElapsedTimer statisticsInterval;
+	DvbDeviceStatistics lastStatistics;
 };
 
 #endif /* DVBDEVICE_H */
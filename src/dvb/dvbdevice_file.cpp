@@ -0,0 +1,469 @@
+/*
+ * dvbdevice_file.cpp
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+
+#include "dvbdevice_file.h"
+#include "dvbtransponder.h"
+
+DvbFileDevice::DvbFileDevice(const QString &path_, bool paced_, QObject *parent) :
+	QThread(parent), path(path_), paced(paced_), frontend(NULL), enabled(false),
+	freqMHz(0), fileFd(-1), regularFile(false), replayPending(false), dvrBuffer(NULL, 0)
+{
+}
+
+DvbFileDevice::~DvbFileDevice()
+{
+	release();
+}
+
+QString DvbFileDevice::getDeviceId()
+{
+	return QLatin1String("F:") + path;
+}
+
+QString DvbFileDevice::getFrontendName()
+{
+	return QLatin1String("Replay ") + QFileInfo(path).fileName();
+}
+
+void DvbFileDevice::enableDvbDump()
+{
+}
+
+DvbFileDevice::TransmissionTypes DvbFileDevice::getTransmissionTypes()
+{
+	return DvbC | DvbS | DvbS2 | DvbT | DvbT2 | Atsc | IsdbT;
+}
+
+DvbFileDevice::Capabilities DvbFileDevice::getCapabilities()
+{
+	return DvbTModulationAuto | DvbTFecAuto | DvbTTransmissionModeAuto | DvbTGuardIntervalAuto;
+}
+
+void DvbFileDevice::setFrontendDevice(DvbFrontendDevice *frontend_)
+{
+	frontend = frontend_;
+}
+
+void DvbFileDevice::setDeviceEnabled(bool enabled_)
+{
+	enabled = enabled_;
+}
+
+bool DvbFileDevice::acquire()
+{
+	Q_ASSERT(fileFd < 0);
+
+	if (!enabled) {
+		return false;
+	}
+
+	if (!QFileInfo(path).exists()) {
+		qCWarning(logDev, "Cannot find replay source %s", qPrintable(path));
+		return false;
+	}
+
+	return true;
+}
+
+bool DvbFileDevice::setHighVoltage(int higherVoltage)
+{
+	Q_UNUSED(higherVoltage)
+	return true;
+}
+
+bool DvbFileDevice::sendMessage(const char *message, int length)
+{
+	Q_UNUSED(message)
+	Q_UNUSED(length)
+	return true;
+}
+
+bool DvbFileDevice::sendBurst(SecBurst burst)
+{
+	Q_UNUSED(burst)
+	return true;
+}
+
+bool DvbFileDevice::satSetup(QString lnbModel, int satNumber, int bpf)
+{
+	Q_UNUSED(lnbModel)
+	Q_UNUSED(satNumber)
+	Q_UNUSED(bpf)
+	return true;
+}
+
+QString DvbFileDevice::findFile(int frequencyMHz) const
+{
+	QFileInfo fileInfo(path);
+
+	if (!fileInfo.isDir()) {
+		return path;
+	}
+
+	QDir dir(path);
+	QStringList candidates;
+	candidates << (QString::number(frequencyMHz) + QLatin1String(".ts")) <<
+		(QString::number(frequencyMHz) + QLatin1String(".bin")) <<
+		QLatin1String("default.ts");
+
+	foreach (const QString &candidate, candidates) {
+		if (dir.exists(candidate)) {
+			return dir.filePath(candidate);
+		}
+	}
+
+	return QString();
+}
+
+bool DvbFileDevice::tune(const DvbTransponder &transponder)
+{
+	stopReplay();
+
+	DvbTransponder copy = transponder;
+	int frequency = copy.frequency();
+
+	switch (copy.getTransmissionType()) {
+	case DvbTransponderBase::DvbS:
+	case DvbTransponderBase::DvbS2:
+		freqMHz = frequency / 1000.0; // kHz
+		break;
+	default:
+		freqMHz = frequency / 1000000.0; // Hz
+		break;
+	}
+
+	fileName = findFile(qRound(freqMHz));
+
+	if (fileName.isEmpty()) {
+		qCDebug(logDev, "No replay file for %.2f MHz in %s", freqMHz, qPrintable(path));
+		return false;
+	}
+
+	// a fifo without writer would block the open call
+	fileFd = open(QFile::encodeName(fileName).constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if (fileFd < 0) {
+		qCWarning(logDev, "Cannot open replay file %s", qPrintable(fileName));
+		return false;
+	}
+
+	struct stat fileStat;
+	regularFile = ((fstat(fileFd, &fileStat) == 0) && S_ISREG(fileStat.st_mode));
+	qCDebug(logDev, "Replaying %s for %.2f MHz", qPrintable(fileName), freqMHz);
+	// the replay starts once the lock is polled, i.e. after the device has discarded
+	// the data of the previous transponder (see isTuned())
+	replayPending = true;
+	return true;
+}
+
+bool DvbFileDevice::getProps(DvbTransponder &transponder)
+{
+	Q_UNUSED(transponder)
+	return true;
+}
+
+bool DvbFileDevice::isTuned()
+{
+	if (fileFd < 0) {
+		return false;
+	}
+
+	if (replayPending) {
+		replayPending = false;
+		startReplay();
+	}
+
+	return true;
+}
+
+float DvbFileDevice::getFrqMHz()
+{
+	return freqMHz;
+}
+
+float DvbFileDevice::getSignal(Scale &scale)
+{
+	if (fileFd < 0) {
+		scale = DvbBackendDevice::NotSupported;
+		return 0;
+	}
+
+	scale = DvbBackendDevice::Percentage;
+	return 100;
+}
+
+float DvbFileDevice::getSnr(DvbBackendDevice::Scale &scale)
+{
+	scale = DvbBackendDevice::NotSupported;
+	return 0;
+}
+
+bool DvbFileDevice::addPidFilter(int pid)
+{
+	// the whole stream is delivered anyway
+	Q_UNUSED(pid)
+	return true;
+}
+
+void DvbFileDevice::removePidFilter(int pid)
+{
+	Q_UNUSED(pid)
+}
+
+bool DvbFileDevice::addSectionFilter(int pid)
+{
+	// sections are reassembled from the stream
+	Q_UNUSED(pid)
+	return false;
+}
+
+void DvbFileDevice::removeSectionFilter(int pid)
+{
+	Q_UNUSED(pid)
+}
+
+void DvbFileDevice::startDescrambling(const QByteArray &pmtSectionData)
+{
+	Q_UNUSED(pmtSectionData)
+}
+
+void DvbFileDevice::stopDescrambling(int serviceId)
+{
+	Q_UNUSED(serviceId)
+}
+
+void DvbFileDevice::release()
+{
+	stopReplay();
+	freqMHz = 0;
+}
+
+void DvbFileDevice::startReplay()
+{
+	Q_ASSERT((fileFd >= 0) && !isRunning());
+	replayStopped = 0;
+	dvrBuffer = DvbDataBuffer(NULL, 0);
+	start();
+}
+
+void DvbFileDevice::stopReplay()
+{
+	if (isRunning()) {
+		stopMutex.lock();
+		replayStopped = 1;
+		stopCondition.wakeAll();
+		stopMutex.unlock();
+		wait();
+	}
+
+	if (fileFd >= 0) {
+		close(fileFd);
+		fileFd = -1;
+	}
+
+	replayPending = false;
+	dvrBuffer = DvbDataBuffer(NULL, 0);
+}
+
+bool DvbFileDevice::waitFor(int msecs)
+{
+	QMutexLocker locker(&stopMutex);
+
+	if (replayStopped == 0) {
+		stopCondition.wait(&stopMutex, msecs);
+	}
+
+	return (replayStopped == 0);
+}
+
+void DvbFileDevice::writePacket(const char *packet)
+{
+	while (dvrBuffer.bufferSize <= 0) {
+		dvrBuffer = frontend->getBuffer();
+		dvrBuffer.dataSize = 0;
+
+		if (dvrBuffer.bufferSize > 0) {
+			break;
+		}
+
+		// the buffer is full; nothing is dropped so that replays are deterministic
+		if (!waitFor(10)) {
+			return;
+		}
+	}
+
+	memcpy(dvrBuffer.data + dvrBuffer.dataSize, packet, 188);
+	dvrBuffer.dataSize += 188;
+
+	if (dvrBuffer.dataSize == dvrBuffer.bufferSize) {
+		flushBuffer();
+	}
+}
+
+void DvbFileDevice::flushBuffer()
+{
+	if ((dvrBuffer.bufferSize > 0) && (dvrBuffer.dataSize > 0)) {
+		frontend->writeBuffer(dvrBuffer);
+		dvrBuffer = DvbDataBuffer(NULL, 0);
+	}
+}
+
+void DvbFileDevice::run()
+{
+	QByteArray readBuffer(188 * 256, Qt::Uninitialized);
+	char *data = readBuffer.data();
+	int size = 0;
+	qint64 totalBytes = 0;
+	QElapsedTimer replayTimer;
+	replayTimer.start();
+
+	// pcr pacing state; pcr values are in units of 90 kHz (base only)
+	int pcrPid = -1;
+	qint64 pcrBase = -1;
+	qint64 clockBase = 0;
+
+	while (replayStopped == 0) {
+		int bytes = int(read(fileFd, data + size, readBuffer.size() - size));
+
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				pollfd pfd;
+				pfd.fd = fileFd;
+				pfd.events = POLLIN;
+				poll(&pfd, 1, 100);
+				continue;
+			}
+
+			qCWarning(logDev, "Cannot read from replay file %s: error %d", qPrintable(fileName),
+				errno);
+			break;
+		}
+
+		if (bytes == 0) {
+			if (!regularFile) {
+				// fifo without writer
+				flushBuffer();
+
+				if (!waitFor(100)) {
+					break;
+				}
+
+				continue;
+			}
+
+			qCInfo(logDev, "Replayed %lld bytes from %s in %lld ms", totalBytes,
+				qPrintable(fileName), replayTimer.elapsed());
+
+			if (!paced) {
+				break;
+			}
+
+			lseek(fileFd, 0, SEEK_SET);
+			size = 0;
+			totalBytes = 0;
+			pcrBase = -1;
+			replayTimer.start();
+			continue;
+		}
+
+		size += bytes;
+		totalBytes += bytes;
+		int pos = 0;
+
+		while (((size - pos) >= 188) && (replayStopped == 0)) {
+			const char *packet = data + pos;
+
+			if ((packet[0] != 0x47) || (((size - pos) >= 376) && (packet[188] != 0x47))) {
+				// resync
+				++pos;
+				continue;
+			}
+
+			pos += 188;
+
+			if (paced && ((packet[3] & 0x20) != 0) && (quint8(packet[4]) >= 7) &&
+			    ((packet[5] & 0x10) != 0)) {
+				int pid = (((quint8(packet[1]) << 8) | quint8(packet[2])) & ((1 << 13) - 1));
+
+				if (pcrPid < 0) {
+					pcrPid = pid;
+				}
+
+				if (pid == pcrPid) {
+					const unsigned char *pcrData =
+						reinterpret_cast<const unsigned char *>(packet + 6);
+					qint64 pcr = ((qint64(pcrData[0]) << 25) | (pcrData[1] << 17) |
+						(pcrData[2] << 9) | (pcrData[3] << 1) | (pcrData[4] >> 7));
+					qint64 delay = 0;
+
+					if (pcrBase >= 0) {
+						// 33 bit wrap around
+						qint64 delta = ((pcr - pcrBase) & ((Q_INT64_C(1) << 33) - 1));
+						delay = ((delta / 90) - (replayTimer.elapsed() - clockBase));
+
+						// discontinuity or the consumers are too slow
+						if ((delta > (90000 * 10)) || (delay < -1000)) {
+							pcrBase = -1;
+							delay = 0;
+						}
+					}
+
+					if (pcrBase < 0) {
+						pcrBase = pcr;
+						clockBase = replayTimer.elapsed();
+					}
+
+					if (delay > 0) {
+						flushBuffer();
+
+						if (!waitFor(int(delay))) {
+							break;
+						}
+					}
+				}
+			}
+
+			writePacket(packet);
+		}
+
+		size -= pos;
+		memmove(data, data + pos, size);
+	}
+
+	flushBuffer();
+}
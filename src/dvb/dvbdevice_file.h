@@ -0,0 +1,100 @@
+/*
+ * dvbdevice_file.h
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef DVBDEVICE_FILE_H
+#define DVBDEVICE_FILE_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include "dvbbackenddevice.h"
+
+/*
+ * replays a transport stream (for example a dvb dump) as if it came from a tuner
+ *
+ * path is either a single file / fifo which is used for every transponder or a
+ * directory; in the latter case a transponder is mapped to "<frequency in MHz>.ts"
+ * (or ".bin") with "default.ts" as fallback
+ *
+ * paced mode follows the pcr of the stream and loops regular files; otherwise the
+ * data is delivered as fast as the consumers allow and replay stops at the end of file
+ */
+
+class DvbFileDevice : public QThread, public DvbBackendDevice
+{
+public:
+	DvbFileDevice(const QString &path_, bool paced_, QObject *parent);
+	~DvbFileDevice();
+
+	QString getDeviceId();
+	QString getFrontendName();
+	void enableDvbDump();
+
+protected:
+	TransmissionTypes getTransmissionTypes();
+	Capabilities getCapabilities();
+	void setFrontendDevice(DvbFrontendDevice *frontend_);
+	void setDeviceEnabled(bool enabled_);
+	bool acquire();
+	bool setHighVoltage(int higherVoltage);
+	bool sendMessage(const char *message, int length);
+	bool sendBurst(SecBurst burst);
+	bool satSetup(QString lnbModel, int satNumber, int bpf);
+	bool tune(const DvbTransponder &transponder); // discards obsolete data
+	bool getProps(DvbTransponder &transponder);
+	bool isTuned();
+	float getFrqMHz();
+	float getSignal(Scale &scale);
+	float getSnr(DvbBackendDevice::Scale &scale);
+	bool addPidFilter(int pid);
+	void removePidFilter(int pid);
+	bool addSectionFilter(int pid);
+	void removeSectionFilter(int pid);
+	void startDescrambling(const QByteArray &pmtSectionData);
+	void stopDescrambling(int serviceId);
+	void release();
+
+private:
+	QString findFile(int frequencyMHz) const;
+	void startReplay();
+	void stopReplay();
+	bool waitFor(int msecs); // returns false if the replay was stopped
+	void writePacket(const char *packet);
+	void flushBuffer();
+	void run();
+
+	QString path;
+	bool paced;
+	DvbFrontendDevice *frontend;
+	bool enabled;
+	float freqMHz;
+	QString fileName;
+	int fileFd;
+	bool regularFile;
+	bool replayPending;
+	DvbDataBuffer dvrBuffer;
+
+	QAtomicInt replayStopped;
+	QMutex stopMutex;
+	QWaitCondition stopCondition;
+};
+
+#endif /* DVBDEVICE_FILE_H */
@@ -29,6 +29,7 @@ extern "C" {
   #include <poll.h>
 }
 
+#include <QElapsedTimer>
 #include <QFile>
 #include <QCheckBox>
 #include <QMessageLogger>
@@ -42,7 +43,8 @@ extern "C" {
 // krazy:excludeall=syscalls
 
 DvbLinuxDevice::DvbLinuxDevice(QObject *parent) : QThread(parent), ready(false), frontend(NULL),
-	enabled(false), dvrFd(-1), dvrBuffer(NULL, 0), cam(parent)
+	enabled(false), frontendFd(-1), monitorFrontend(false), dvrFd(-1), dvrKernelBufferSize(0),
+	dvrBuffer(NULL, 0), cam(parent)
 {
 	verbose = 1;
 	numDemux = 0;
@@ -268,15 +270,29 @@ bool DvbLinuxDevice::acquire()
 		return false;
 	}
 
+	// a second (read-only) handle, so that the status can be read without libdvbv5
+	frontendFd = open(QFile::encodeName(frontendPath).constData(),
+		O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if (frontendFd < 0) {
+		qCWarning(logDev, "Cannot open frontend %s", qPrintable(frontendPath));
+		dvb_fe_close(dvbv5_parms);
+		dvbv5_parms = NULL;
+		return false;
+	}
+
 	dvrFd = open(QFile::encodeName(dvrPath).constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
 
 	if (dvrFd < 0) {
 		qCWarning(logDev, "Cannot open dvr %s", qPrintable(dvrPath));
+		close(frontendFd);
+		frontendFd = -1;
 		dvb_fe_close(dvbv5_parms);
 		dvbv5_parms = NULL;
 		return false;
 	}
 
+	dvrKernelBufferSize = (10 * 188 * 1024); // default of the kernel
 	return true;
 }
 
@@ -897,6 +913,51 @@ bool DvbLinuxDevice::satSetup(QString lnbModel, int satNumber, int bpf)
 	return true;
 }
 
+static qint64 maximumBitRate(const DvbTransponder &transponder) // bits per second
+{
+	switch (transponder.getTransmissionType()) {
+	case DvbTransponderBase::DvbC:
+		return (qint64(transponder.as<DvbCTransponder>()->symbolRate) * 8);
+	case DvbTransponderBase::DvbS:
+		return (qint64(transponder.as<DvbSTransponder>()->symbolRate) * 2);
+	case DvbTransponderBase::DvbS2:
+		return (qint64(transponder.as<DvbS2Transponder>()->symbolRate) * 5);
+	case DvbTransponderBase::DvbT:
+		return 32000000;
+	case DvbTransponderBase::DvbT2:
+		return 50000000;
+	case DvbTransponderBase::Atsc:
+		return 20000000;
+	case DvbTransponderBase::IsdbT:
+		return 24000000;
+	case DvbTransponderBase::Invalid:
+		break;
+	}
+
+	return 0;
+}
+
+void DvbLinuxDevice::setDvrKernelBufferSize(const DvbTransponder &transponder)
+{
+	// the kernel buffer should be able to hold about half a second of data
+	int size = int(qBound(qint64(10 * 188 * 1024), maximumBitRate(transponder) / 16,
+		qint64(32 * 1024 * 1024)));
+	size = (((size + 4095) / 4096) * 4096);
+
+	if (size == dvrKernelBufferSize) {
+		return;
+	}
+
+	if (ioctl(dvrFd, DMX_SET_BUFFER_SIZE, size) != 0) {
+		qCWarning(logDev, "Cannot set the buffer size of dvr %s to %d bytes", qPrintable(dvrPath),
+			size);
+		return;
+	}
+
+	qCDebug(logDev, "Buffer size of dvr %s set to %d bytes", qPrintable(dvrPath), size);
+	dvrKernelBufferSize = size;
+}
+
 bool DvbLinuxDevice::tune(const DvbTransponder &transponder)
 {
 	Q_ASSERT(dvbv5_parms);
@@ -1066,11 +1127,39 @@ bool DvbLinuxDevice::tune(const DvbTransponder &transponder)
 		return false;
 	}
 
-	if (dvb_fe_set_parms(dvbv5_parms) != 0) {
+	// the switch keeps its port; repeating the DiSEqC sequence only costs time
+	int satNumber = dvbv5_parms->sat_number;
+	QString port;
+
+	if (((delsys == SYS_DVBS) || (delsys == SYS_DVBS2)) && (satNumber >= 0) &&
+	    (dvbv5_parms->lnb != NULL)) {
+		uint32_t polarization = 0;
+		dvb_fe_retrieve_parm(dvbv5_parms, DTV_POLARIZATION, &polarization);
+		bool highBand = ((dvbv5_parms->lnb->rangeswitch > 0) &&
+			(freqMHz >= dvbv5_parms->lnb->rangeswitch));
+		port = QString(QLatin1String("%1 %2 %3 %4")).arg(QLatin1String(dvbv5_parms->lnb->alias)).
+			arg(satNumber).arg(polarization).arg(highBand);
+
+		// only if the last tune locked (the switch may have missed the command)
+		if ((port == diseqcPort) && (frontendLocked.loadAcquire() != 0)) {
+			qCDebug(logDev, "DiSEqC port %d is already selected", satNumber);
+			dvbv5_parms->sat_number = -1;
+		}
+	}
+
+	frontendLocked.storeRelease(0);
+	int result = dvb_fe_set_parms(dvbv5_parms);
+	dvbv5_parms->sat_number = satNumber;
+
+	if (result != 0) {
 		qCWarning(logDev, "ioctl FE_SET_PROPERTY failed for frontend %s", qPrintable(frontendPath));
+		diseqcPort.clear();
 		return false;
 	}
 
+	diseqcPort = port;
+	setDvrKernelBufferSize(transponder);
+	monitorFrontend = true;
 	startDvr();
 	return true;
 }
@@ -1414,6 +1503,60 @@ void DvbLinuxDevice::removePidFilter(int pid)
 	close(dmxFds.take(pid));
 }
 
+bool DvbLinuxDevice::addSectionFilter(int pid)
+{
+	Q_ASSERT(dvbv5_parms);
+	QMutexLocker locker(&sectionFdMutex);
+
+	if (sectionFds.contains(pid)) {
+		qCWarning(logDev, "Section filter already set up for pid %d", pid);
+		return false;
+	}
+
+	int dmxFd = open(QFile::encodeName(demuxPath).constData(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+	if (dmxFd < 0) {
+		qCWarning(logDev, "Cannot open demux %s", qPrintable(demuxPath));
+		return false;
+	}
+
+	// all tables of the pid are passed; the kernel checks the crc
+	dmx_sct_filter_params sct_filter;
+	memset(&sct_filter, 0, sizeof(sct_filter));
+	sct_filter.pid = ushort(pid);
+	sct_filter.flags = (DMX_IMMEDIATE_START | DMX_CHECK_CRC);
+
+	if (ioctl(dmxFd, DMX_SET_FILTER, &sct_filter) != 0) {
+		qCWarning(logDev, "Cannot set up section filter for demux %s", qPrintable(demuxPath));
+		close(dmxFd);
+		return false;
+	}
+
+	sectionFds.insert(pid, dmxFd);
+	updateDvrThread();
+	return true;
+}
+
+void DvbLinuxDevice::removeSectionFilter(int pid)
+{
+	QMutexLocker locker(&sectionFdMutex);
+
+	if (!sectionFds.contains(pid)) {
+		qCWarning(logDev, "No section filter set up for PID %i", pid);
+		return;
+	}
+
+	int dmxFd = sectionFds.take(pid);
+
+	if (isRunning()) {
+		// the dvr thread may be polling the fd
+		obsoleteSectionFds.append(dmxFd);
+		updateDvrThread();
+	} else {
+		close(dmxFd);
+	}
+}
+
 void DvbLinuxDevice::startDescrambling(const QByteArray &pmtSectionData)
 {
 	cam.startDescrambling(pmtSectionData);
@@ -1427,12 +1570,10 @@ void DvbLinuxDevice::stopDescrambling(int serviceId)
 void DvbLinuxDevice::release()
 {
 	stopDvr();
+	diseqcPort.clear();
 
-	if (dvrBuffer.data != NULL) {
-		dvrBuffer.dataSize = 0;
-		frontend->writeBuffer(dvrBuffer);
-		dvrBuffer.data = NULL;
-	}
+	// the data buffer may be reallocated while the device is released
+	dvrBuffer = DvbDataBuffer(NULL, 0);
 
 	if (dvrPipe[0] >= 0) {
 		close(dvrPipe[0]);
@@ -1449,12 +1590,27 @@ void DvbLinuxDevice::release()
 		dvrFd = -1;
 	}
 
+	if (frontendFd >= 0) {
+		close(frontendFd);
+		frontendFd = -1;
+	}
+
 	foreach (int dmxFd, dmxFds) {
 		close(dmxFd);
 	}
 
 	dmxFds.clear();
 
+	sectionFdMutex.lock();
+	closeObsoleteSectionFds();
+
+	foreach (int dmxFd, sectionFds) {
+		close(dmxFd);
+	}
+
+	sectionFds.clear();
+	sectionFdMutex.unlock();
+
 	if (dvbv5_parms) {
 		dvb_fe_close(dvbv5_parms);
 		dvbv5_parms = NULL;
@@ -1475,13 +1631,34 @@ void DvbLinuxDevice::startDvr()
 			qCCritical(logDev, "Cannot create pipe");
 			return;
 		}
+
+		fcntl(dvrPipe[0], F_SETFL, O_NONBLOCK);
+	}
+
+	// discard stale commands and obsolete sections
+
+	char command;
+
+	while (read(dvrPipe[0], &command, 1) == 1) {
 	}
 
-	if (dvrBuffer.data == NULL) {
-		dvrBuffer = frontend->getBuffer();
+	sectionFdMutex.lock();
+	closeObsoleteSectionFds();
+
+	foreach (int dmxFd, sectionFds) {
+		char section[4096];
+
+		while (read(dmxFd, section, sizeof(section)) > 0) {
+		}
 	}
 
-	while (true) {
+	sectionFdMutex.unlock();
+
+	dvrBuffer = frontend->getBuffer();
+
+	// discard obsolete data; nothing is committed to the buffer at this point
+
+	while (dvrBuffer.bufferSize > 0) {
 		int bufferSize = dvrBuffer.bufferSize;
 		int dataSize = int(read(dvrFd, dvrBuffer.data, bufferSize));
 
@@ -1490,7 +1667,7 @@ void DvbLinuxDevice::startDvr()
 				break;
 			}
 
-			if (errno == EINTR) {
+			if ((errno == EINTR) || (errno == EOVERFLOW)) {
 				continue;
 			}
 
@@ -1523,31 +1700,93 @@ void DvbLinuxDevice::stopDvr()
 	if (isRunning()) {
 		Q_ASSERT((dvrPipe[0] >= 0) && (dvrPipe[1] >= 0));
 
-		if (write(dvrPipe[1], " ", 1) != 1) {
+		if (write(dvrPipe[1], "s", 1) != 1) {
 			qCWarning(logDev, "Cannot write to pipe");
 		}
 
 		wait();
-		char data;
+	}
+}
 
-		if (read(dvrPipe[0], &data, 1) != 1) {
-			qCWarning(logDev, "Cannot read from pipe");
-		}
+void DvbLinuxDevice::updateDvrThread()
+{
+	// sectionFdMutex has to be locked
+	if (isRunning() && (write(dvrPipe[1], "u", 1) != 1)) {
+		qCWarning(logDev, "Cannot write to pipe");
 	}
 }
 
-void DvbLinuxDevice::run()
+void DvbLinuxDevice::closeObsoleteSectionFds()
+{
+	// sectionFdMutex has to be locked
+	foreach (int dmxFd, obsoleteSectionFds) {
+		close(dmxFd);
+	}
+
+	obsoleteSectionFds.clear();
+}
+
+void DvbLinuxDevice::updatePollFds(QVector<pollfd> &pollFds, QVector<int> &pollPids)
 {
-	Q_ASSERT((dvrFd >= 0) && (dvrPipe[0] >= 0) && (dvrBuffer.data != NULL));
-	pollfd pollFds[2];
-	memset(&pollFds, 0, sizeof(pollFds));
+	// the control pipe comes first, then the section filters and the dvr
+	QMutexLocker locker(&sectionFdMutex);
+	closeObsoleteSectionFds();
+	pollFds.resize(sectionFds.size() + 2);
+	pollPids.resize(sectionFds.size() + 2);
+	memset(pollFds.data(), 0, pollFds.size() * sizeof(pollfd));
 	pollFds[0].fd = dvrPipe[0];
 	pollFds[0].events = POLLIN;
-	pollFds[1].fd = dvrFd;
-	pollFds[1].events = POLLIN;
+	pollPids[0] = -1;
+	int index = 1;
+
+	for (QMap<int, int>::ConstIterator it = sectionFds.constBegin(); it != sectionFds.constEnd();
+	     ++it) {
+		pollFds[index].fd = it.value();
+		pollFds[index].events = POLLIN;
+		pollPids[index] = it.key();
+		++index;
+	}
+
+	pollFds[index].fd = dvrFd;
+	pollFds[index].events = POLLIN;
+	pollPids[index] = -1;
+}
+
+void DvbLinuxDevice::run()
+{
+	Q_ASSERT((dvrFd >= 0) && (dvrPipe[0] >= 0));
+	QVector<pollfd> pollFds;
+	QVector<int> pollPids;
+	updatePollFds(pollFds, pollPids);
+	char section[4096];
+	// the frontend status is watched until lock (or for at most MaximumMonitorTime)
+	QElapsedTimer monitorTimer;
+	monitorTimer.start();
+	qint64 nextStatusCheck = 0;
+	int lastStatus = -1;
 
 	while (true) {
-		if (poll(pollFds, 2, -1) < 0) {
+		int pollFdCount = pollFds.size();
+		int timeout = -1;
+
+		if (monitorFrontend) {
+			timeout = int(qMax(nextStatusCheck - monitorTimer.elapsed(), Q_INT64_C(0)));
+		}
+
+		if (dvrBuffer.bufferSize <= 0) {
+			dvrBuffer = frontend->getBuffer();
+
+			if (dvrBuffer.bufferSize <= 0) {
+				// the buffer is full; don't wait for the dvr and retry later
+				--pollFdCount;
+
+				if ((timeout < 0) || (timeout > 10)) {
+					timeout = 10;
+				}
+			}
+		}
+
+		if (poll(pollFds.data(), pollFdCount, timeout) < 0) {
 			if (errno == EINTR) {
 				continue;
 			}
@@ -1556,11 +1795,83 @@ void DvbLinuxDevice::run()
 			return;
 		}
 
-		if ((pollFds[0].revents & POLLIN) != 0) {
-			return;
+		if (monitorFrontend && (monitorTimer.elapsed() >= nextStatusCheck)) {
+			fe_status_t status = fe_status_t(0);
+
+			if (ioctl(frontendFd, FE_READ_STATUS, &status) != 0) {
+				qCWarning(logDev, "Cannot read frontend status: error %d", errno);
+				monitorFrontend = false;
+			} else {
+				if (int(status) != lastStatus) {
+					lastStatus = status;
+					int frontendStatus = 0;
+
+					if ((status & FE_HAS_SIGNAL) != 0) {
+						frontendStatus |= HasSignal;
+					}
+
+					if ((status & FE_HAS_CARRIER) != 0) {
+						frontendStatus |= HasCarrier;
+					}
+
+					if ((status & FE_HAS_VITERBI) != 0) {
+						frontendStatus |= HasViterbi;
+					}
+
+					if ((status & FE_HAS_SYNC) != 0) {
+						frontendStatus |= HasSync;
+					}
+
+					if ((status & FE_HAS_LOCK) != 0) {
+						frontendStatus |= HasLock;
+					}
+
+					frontend->reportFrontendStatus(frontendStatus);
+				}
+
+				if ((status & FE_HAS_LOCK) != 0) {
+					frontendLocked.storeRelease(1);
+					monitorFrontend = false;
+				} else if (monitorTimer.elapsed() > MaximumMonitorTime) {
+					monitorFrontend = false;
+				}
+			}
+
+			nextStatusCheck = (monitorTimer.elapsed() + StatusCheckInterval);
+		}
+
+		if ((pollFds.at(0).revents & POLLIN) != 0) {
+			char command;
+
+			if (read(dvrPipe[0], &command, 1) == 1) {
+				if (command != 'u') {
+					return;
+				}
+
+				updatePollFds(pollFds, pollPids);
+				continue;
+			}
+		}
+
+		for (int i = 1; i < (pollFds.size() - 1); ++i) {
+			if ((pollFds.at(i).revents & (POLLIN | POLLERR)) == 0) {
+				continue;
+			}
+
+			// one section per read; errors like EOVERFLOW only mean lost sections
+			int size = int(read(pollFds.at(i).fd, section, sizeof(section)));
+
+			if (size > 0) {
+				frontend->writeSection(pollPids.at(i), section, size);
+			}
+		}
+
+		if (pollFdCount < pollFds.size()) {
+			continue;
 		}
 
 		while (true) {
+			// read as much as fits into the contiguous free space of the buffer
 			int bufferSize = dvrBuffer.bufferSize;
 			int dataSize = int(read(dvrFd, dvrBuffer.data, bufferSize));
 
@@ -1573,6 +1884,13 @@ void DvbLinuxDevice::run()
 					continue;
 				}
 
+				if (errno == EOVERFLOW) {
+					// the kernel has dropped the content of its buffer
+					qCWarning(logDev, "Data lost in dvr %s: buffer overflow", qPrintable(dvrPath));
+					frontend->reportOverflow(dvrKernelBufferSize);
+					continue;
+				}
+
 				qCWarning(logDev, "Cannot read from dvr %s: error %d", qPrintable(dvrPath), errno);
 				dataSize = int(read(dvrFd, dvrBuffer.data, bufferSize));
 
@@ -1596,12 +1914,10 @@ void DvbLinuxDevice::run()
 				dvrBuffer = frontend->getBuffer();
 			}
 
-			if (dataSize != bufferSize) {
+			if ((dataSize != bufferSize) || (dvrBuffer.bufferSize <= 0)) {
 				break;
 			}
 		}
-
-		msleep(10);
 	}
 }
 
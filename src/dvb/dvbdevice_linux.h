@@ -21,7 +21,10 @@
 #ifndef DVBDEVICE_LINUX_H
 #define DVBDEVICE_LINUX_H
 
+#include <QAtomicInt>
+#include <QMutex>
 #include <QThread>
+#include <QVector>
 #include "dvbbackenddevice.h"
 #include "dvbcam_linux.h"
 
@@ -32,6 +35,8 @@ extern "C" {
   #include <libdvbv5/dvb-scan.h>
 }
 
+struct pollfd;
+
 class DvbLinuxDevice : public QThread, public DvbBackendDevice
 {
 public:
@@ -78,13 +83,25 @@ protected:
 	float getSnr(DvbBackendDevice::Scale &scale);
 	bool addPidFilter(int pid);
 	void removePidFilter(int pid);
+	bool addSectionFilter(int pid);
+	void removeSectionFilter(int pid);
 	void startDescrambling(const QByteArray &pmtSectionData);
 	void stopDescrambling(int serviceId);
 	void release();
 
 private:
+	enum {
+		StatusCheckInterval = 10, // ms; while the frontend is watched
+		// ms; beyond the longest rotor movement (90 s) plus the tuning timeout
+		MaximumMonitorTime = 120000
+	};
+
+	void setDvrKernelBufferSize(const DvbTransponder &transponder);
 	void startDvr();
 	void stopDvr();
+	void updateDvrThread();
+	void closeObsoleteSectionFds();
+	void updatePollFds(QVector<pollfd> &pollFds, QVector<int> &pollPids);
 	void run();
 
 	bool ready;
@@ -95,12 +112,19 @@ private:
 	DvbFrontendDevice *frontend;
 	bool enabled;
 	QMap<int, int> dmxFds;
+	QMutex sectionFdMutex;
+	QMap<int, int> sectionFds; // protected by sectionFdMutex
+	QList<int> obsoleteSectionFds; // closed by the dvr thread; protected by sectionFdMutex
 
 	float freqMHz;
 
 	int verbose;
-	int frontendFd;
+	int frontendFd; // read-only; used by the dvr thread to watch the tuning progress
+	bool monitorFrontend; // only accessed by the dvr thread while it's running
+	QAtomicInt frontendLocked; // set by the dvr thread; reset by tune()
+	QString diseqcPort; // switch setting of the last tune (empty = unknown)
 	int dvrFd;
+	int dvrKernelBufferSize; // bytes
 	int dvrPipe[2];
 	DvbDataBuffer dvrBuffer;
 
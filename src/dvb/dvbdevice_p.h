@@ -21,15 +21,228 @@
 #ifndef DVBDEVICE_P_H
 #define DVBDEVICE_P_H
 
+#include <QAtomicInt>
+#include <QHash>
+#include <QMap>
+#include <QVector>
+#include <string.h>
+#include "dvbbackenddevice.h"
+
+class DvbFilterInternal;
+
+/*
+ * single-producer / single-consumer ring buffer between the backend thread
+ * (producer) and DvbDevice (consumer); the positions are always multiples of
+ * 188 bytes, so that a packet never wraps around the end of the buffer
+ */
+
 class DvbDeviceDataBuffer
 {
 public:
-	DvbDeviceDataBuffer() { }
-	~DvbDeviceDataBuffer() { }
+	DvbDeviceDataBuffer() : data(NULL), size(0), readPos(0), writePos(0), consumedBytes(0) { }
+	~DvbDeviceDataBuffer();
+
+	// must only be called if neither the producer nor the consumer are active
+	void resize(int minimumSize);
+
+	int getSize() const
+	{
+		return size;
+	}
+
+	// producer side
+
+	char *getWritePointer() const
+	{
+		return (data + writePos);
+	}
 
-	char data[5 * 188];
+	int getWritableSize() const;
+	bool commit(int dataSize); // returns true if the buffer was empty before
+
+	// total amount of data committed since resize(); may be called by any thread
+	qint64 getCommittedBytes() const
+	{
+		return committedBytes.loadAcquire();
+	}
+
+	// consumer side
+
+	const char *getReadPointer() const
+	{
+		return (data + readPos);
+	}
+
+	int getReadableSize() const;
+	int getUsedSize() const;
+	void consume(int dataSize);
+	// drops the data up to 'position' (see getCommittedBytes())
+	void discard(qint64 position);
+
+private:
+	Q_DISABLE_COPY(DvbDeviceDataBuffer)
+
+	char *data;
 	int size;
-	DvbDeviceDataBuffer *next;
+	int readPos; // only modified by the consumer
+	int writePos; // only modified by the producer
+	qint64 consumedBytes; // only modified by the consumer
+	QAtomicInt usedSize;
+	QAtomicInteger<qint64> committedBytes;
+};
+
+class DvbPidFilterBatch
+{
+public:
+	DvbPidFilterBatch() : filter(NULL), count(0) { }
+	~DvbPidFilterBatch() { }
+
+	DvbPidFilter *filter;
+	QVector<const char *> packets;
+	int count;
+};
+
+/*
+ * pid -> filters lookup table used by the demux thread; the packets are
+ * collected per filter and passed to the filters in processBatches();
+ * filters for pid 0x2000 receive all packets
+ *
+ * layout: entries[pid] is an offset into filterIndexes, where the batch
+ * indexes of the pid are stored consecutively, followed by -1; slot 0 of
+ * filterIndexes is a lone -1, the shared empty list, so that the pids
+ * without filters (entries[pid] == 0) need no special case in addPacket()
+ */
+
+class DvbPidFilterTable
+{
+public:
+	enum {
+		MaximumBatchSize = 348 // packets
+	};
+
+	explicit DvbPidFilterTable(const QMap<int, DvbFilterInternal> &filterMap);
+	~DvbPidFilterTable() { }
+
+	void addPacket(int pid, const char *packet)
+	{
+		for (const int *index = (filterIndexes.constData() + entries[pid]); *index >= 0;
+		     ++index) {
+			DvbPidFilterBatch &batch = batches[*index];
+			batch.packets[batch.count++] = packet;
+		}
+	}
+
+	void processBatches();
+
+private:
+	Q_DISABLE_COPY(DvbPidFilterTable)
+
+	void addEntry(int pid, const QList<DvbPidFilter *> &pidFilters,
+		QMap<DvbPidFilter *, int> &batchIndexes);
+
+	int entries[8192]; // offset into filterIndexes (see above)
+	QVector<int> filterIndexes;
+	QVector<DvbPidFilterBatch> batches;
+};
+
+/*
+ * stream counters; updated by the demux thread while holding filterMutex
+ */
+
+class DvbStreamCounters
+{
+public:
+	DvbStreamCounters()
+	{
+		reset();
+	}
+
+	~DvbStreamCounters() { }
+
+	void reset();
+
+	void resetContinuity()
+	{
+		memset(continuity, 0xff, sizeof(continuity));
+	}
+
+	void addPacket(int pid, const char *packet)
+	{
+		++packets[pid];
+
+		if (((packet[3] & 0x10) == 0) || (pid == 0x1fff)) {
+			// the continuity counter only increments for packets with payload
+			return;
+		}
+
+		unsigned char counter = (packet[3] & 0x0f);
+		unsigned char expected = ((continuity[pid] + 1) & 0x0f);
+
+		if ((continuity[pid] != 0xff) && (counter != expected) &&
+		    (counter != continuity[pid])) {
+			// the discontinuity indicator marks an expected discontinuity
+			if (((packet[3] & 0x20) == 0) || (packet[4] == 0) ||
+			    ((packet[5] & 0x80) == 0)) {
+				++ccErrors[pid];
+			}
+		}
+
+		continuity[pid] = counter;
+	}
+
+	qint64 packets[8192];
+	int ccErrors[8192];
+	int teiPackets[8192];
+	int crcErrors[8192];
+	unsigned char continuity[8192]; // 0xff = unknown
+	int maximumUsedSize; // of the data buffer; bytes
+};
+
+class DvbSectionTableState
+{
+public:
+	DvbSectionTableState() : versionNumber(-1), lastSectionNumber(-1), complete(false) { }
+	~DvbSectionTableState() { }
+
+	void reset(int versionNumber_, int lastSectionNumber_);
+	bool isComplete() const;
+
+	int versionNumber;
+	int lastSectionNumber;
+	bool complete;
+	quint32 receivedSections[8]; // bitmask
+	short segmentLastSectionNumbers[32]; // eit only; -1 = unknown
+};
+
+/*
+ * passes only new or changed sections to the wrapped filter; sections are
+ * identified by (table id, table id extension, section number) and for the eit
+ * additionally by (transport stream id, original network id); they are compared
+ * by their crc (which covers the version number as well)
+ */
+
+class DvbChangedSectionFilter : public DvbSectionFilter
+{
+public:
+	DvbChangedSectionFilter(int pid_, DvbSectionFilter *filter_) : pid(pid_), filter(filter_) { }
+	~DvbChangedSectionFilter() { }
+
+	void processSection(const char *data, int size);
+
+	void reset()
+	{
+		sectionCrcs.clear();
+		tables.clear();
+	}
+
+	int pid;
+	DvbSectionFilter *filter; // NULL once the filter has been removed
+
+private:
+	Q_DISABLE_COPY(DvbChangedSectionFilter)
+
+	QHash<quint64, quint32> sectionCrcs;
+	QHash<quint64, DvbSectionTableState> tables; // key = table id, table id extension (, ids)
 };
 
 #endif /* DVBDEVICE_P_H */
@@ -70,6 +70,13 @@ DvbEpgModel::DvbEpgModel(DvbManager *manager_, QObject *parent) : QObject(parent
 		this, SLOT(channelRemoved(DvbSharedChannel)));
 	connect(manager->getRecordingModel(), SIGNAL(recordingRemoved(DvbSharedRecording)),
 		this, SLOT(recordingRemoved(DvbSharedRecording)));
+	// auto recording rules are evaluated for new and updated entries
+	connect(this, SIGNAL(entryAdded(DvbSharedEpgEntry)),
+		manager->getRecordingModel(), SLOT(epgEntryChanged(DvbSharedEpgEntry)));
+	connect(this, SIGNAL(entryUpdated(DvbSharedEpgEntry)),
+		manager->getRecordingModel(), SLOT(epgEntryChanged(DvbSharedEpgEntry)));
+	connect(this, SIGNAL(entryRemoved(DvbSharedEpgEntry)),
+		manager->getRecordingModel(), SLOT(epgEntryRemoved(DvbSharedEpgEntry)));
 
 	// TODO use SQL to store epg data
 
@@ -599,7 +606,8 @@ DvbEpgFilter::DvbEpgFilter(DvbManager *manager_, DvbDevice *device_,
 	manager = manager_;
 	source = channel->source;
 	transponder = channel->transponder;
-	device->addSectionFilter(0x12, this);
+	// eit parsing and the epg model updates only need to happen once per change
+	device->addSectionFilter(0x12, this, true);
 	channelModel = manager->getChannelModel();
 	epgModel = manager->getEpgModel();
 }
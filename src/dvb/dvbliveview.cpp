@@ -28,6 +28,7 @@
 #include <QPainter>
 #include <QSet>
 #include <QSocketNotifier>
+#include <string.h>
 #include <QStandardPaths>
 #include <sys/stat.h>  // bsd compatibility
 #include <sys/types.h>  // bsd compatibility
@@ -37,6 +38,7 @@
 #include "dvbliveview.h"
 #include "dvbliveview_p.h"
 #include "dvbmanager.h"
+#include "dvbzapaccelerator.h"
 
 void DvbOsd::init(DvbManager *manager_, OsdLevel level_, const QString &channelName_,
 	const QList<DvbSharedEpgEntry> &epgEntries)
@@ -144,8 +146,114 @@ QPixmap DvbOsd::paintOsd(QRect &rect, const QFont &font, Qt::LayoutDirection)
 	return pixmap;
 }
 
+DvbZapTimes::DvbZapTimes()
+{
+	for (int i = 0; i < StageCount; ++i) {
+		times[i] = -1;
+	}
+}
+
+QString DvbZapTimes::stageName(int stage)
+{
+	switch (stage) {
+	case DeviceAcquired:
+		return QLatin1String("DeviceAcquired");
+	case Tuned:
+		return QLatin1String("Tuned");
+	case Locked:
+		return QLatin1String("Locked");
+	case FirstPacket:
+		return QLatin1String("FirstPacket");
+	case FirstPmt:
+		return QLatin1String("FirstPmt");
+	case FirstKeyFrame:
+		return QLatin1String("FirstKeyFrame");
+	case FirstOutput:
+		return QLatin1String("FirstOutput");
+	case FirstFrame:
+		return QLatin1String("FirstFrame");
+	}
+
+	return QString();
+}
+
+static QString zapStageText(int stage)
+{
+	switch (stage) {
+	case DvbZapTimes::DeviceAcquired:
+		return i18nc("osd zap stage", "Device acquired");
+	case DvbZapTimes::Tuned:
+		return i18nc("osd zap stage", "Tuned");
+	case DvbZapTimes::Locked:
+		return i18nc("osd zap stage", "Locked");
+	case DvbZapTimes::FirstPacket:
+		return i18nc("osd zap stage", "First packet");
+	case DvbZapTimes::FirstPmt:
+		return i18nc("osd zap stage", "First PMT");
+	case DvbZapTimes::FirstKeyFrame:
+		return i18nc("osd zap stage", "First key frame");
+	case DvbZapTimes::FirstOutput:
+		return i18nc("osd zap stage", "Output started");
+	case DvbZapTimes::FirstFrame:
+		return i18nc("osd zap stage", "Picture displayed");
+	}
+
+	return QString();
+}
+
+DvbZapStatistics::Histogram::Histogram() : count(0), sum(0), minimum(0), maximum(0)
+{
+	for (int i = 0; i < BucketCount; ++i) {
+		buckets[i] = 0;
+	}
+}
+
+void DvbZapStatistics::add(const DvbZapTimes &zapTimes)
+{
+	for (int stage = 0; stage < DvbZapTimes::StageCount; ++stage) {
+		int time = zapTimes.times[stage];
+
+		if (time < 0) {
+			continue;
+		}
+
+		Histogram &histogram = histograms[stage];
+
+		if ((histogram.count == 0) || (time < histogram.minimum)) {
+			histogram.minimum = time;
+		}
+
+		if ((histogram.count == 0) || (time > histogram.maximum)) {
+			histogram.maximum = time;
+		}
+
+		++histogram.count;
+		histogram.sum += time;
+		int bucket = 0;
+
+		while ((bucketLimit(bucket) >= 0) && (time >= bucketLimit(bucket))) {
+			++bucket;
+		}
+
+		++histogram.buckets[bucket];
+	}
+}
+
+int DvbZapStatistics::bucketLimit(int bucket)
+{
+	static const int limits[BucketCount - 1] =
+		{ 50, 100, 200, 300, 500, 750, 1000, 1500, 2000, 3000, 5000 };
+
+	if ((bucket < 0) || (bucket >= (BucketCount - 1))) {
+		return -1;
+	}
+
+	return limits[bucket];
+}
+
 DvbLiveView::DvbLiveView(DvbManager *manager_, QObject *parent) : QObject(parent),
-	manager(manager_), device(NULL), videoPid(-1), audioPid(-1), subtitlePid(-1), pausedTime(0)
+	manager(manager_), device(NULL), videoPid(-1), audioPid(-1), subtitlePid(-1), pausedTime(0),
+	tracksFixed(false), zapPending(false), zapTimesOsd(false)
 {
 	mediaWidget = manager->getMediaWidget();
 	osdWidget = mediaWidget->getOsdWidget();
@@ -157,12 +265,15 @@ DvbLiveView::DvbLiveView(DvbManager *manager_, QObject *parent) : QObject(parent
 		this, SLOT(pmtSectionChanged(QByteArray)));
 	connect(&patPmtTimer, SIGNAL(timeout()), this, SLOT(insertPatPmt()));
 	connect(&osdTimer, SIGNAL(timeout()), this, SLOT(osdTimeout()));
+	zapTimeoutTimer.setSingleShot(true);
+	connect(&zapTimeoutTimer, SIGNAL(timeout()), this, SLOT(finishZap()));
 
 	connect(internal, SIGNAL(currentAudioStreamChanged(int)),
 		this, SLOT(currentAudioStreamChanged(int)));
 	connect(internal, SIGNAL(currentSubtitleChanged(int)),
 		this, SLOT(currentSubtitleChanged(int)));
 	connect(internal, SIGNAL(replay()), this, SLOT(replay()));
+	connect(internal, SIGNAL(videoOutputStarted()), this, SLOT(videoOutputStarted()));
 	connect(internal, SIGNAL(playbackFinished()), this, SLOT(playbackFinished()));
 	connect(internal, SIGNAL(playbackStatusChanged(MediaWidget::PlaybackStatus)),
 		this, SLOT(playbackStatusChanged(MediaWidget::PlaybackStatus)));
@@ -172,6 +283,10 @@ DvbLiveView::DvbLiveView(DvbManager *manager_, QObject *parent) : QObject(parent
 
 DvbLiveView::~DvbLiveView()
 {
+	// the zap accelerator is already gone if the manager is destroyed
+	if (manager->getZapAccelerator() != NULL) {
+		manager->getZapAccelerator()->releaseDevices();
+	}
 }
 
 void DvbLiveView::replay()
@@ -179,9 +294,15 @@ void DvbLiveView::replay()
 	if (device == NULL) {
 		device = manager->requestDevice(channel->source, channel->transponder,
 			DvbManager::Shared);
+
+		if (zapPending && (device != NULL)) {
+			zapTimes.times[DvbZapTimes::DeviceAcquired] = int(zapTimer.elapsed());
+		}
 	}
 
 	if (device == NULL) {
+		zapPending = false;
+		zapTimeoutTimer.stop();
 		channel = DvbSharedChannel();
 		mediaWidget->stop();
 
@@ -210,10 +331,23 @@ void DvbLiveView::replay()
 	videoPid = -1;
 	audioPid = channel->audioPid;
 	subtitlePid = -1;
-	pmtSectionChanged(channel->pmtSectionData);
+
+	// a pre-tuned channel comes with the current pmt and the packets since the last key frame
+	DvbZapAccelerator *zapAccelerator = manager->getZapAccelerator();
+	QByteArray pmtSectionData = zapAccelerator->getPmtSection(device, channel);
+
+	if (pmtSectionData.isEmpty()) {
+		// start with the cached pmt; the pmt filter only corrects it
+		pmtSectionData = channel->pmtSectionData;
+	}
+
+	internal->setPreTunedData(zapAccelerator->takeData(device, channel));
+	updatePmtSection(pmtSectionData);
 	patPmtTimer.start(500);
 
+	internal->mutex.lock();
 	internal->buffer.reserve(87 * 188);
+	internal->mutex.unlock();
 	QTimer::singleShot(2000, this, SLOT(showOsd()));
 }
 
@@ -234,21 +368,77 @@ DvbDevice *DvbLiveView::getDevice() const
 
 void DvbLiveView::playChannel(const DvbSharedChannel &channel_)
 {
+	zapTimer.start();
 	DvbDevice *newDevice = NULL;
+	int deviceTime = -1;
 
 	if ((channel.constData() != NULL) && (channel->source == channel_->source) &&
 	    (channel->transponder.corresponds(channel_->transponder))) {
 		newDevice = manager->requestDevice(channel->source, channel->transponder,
 			DvbManager::Shared);
+
+		if (newDevice != NULL) {
+			deviceTime = int(zapTimer.elapsed());
+		}
 	}
 
-	playbackStatusChanged(MediaWidget::Idle);
+	// the device of the current channel is still in use, so that it can stay tuned
+	manager->getZapAccelerator()->channelChanged(channel_);
+	stopPlayback();
 	channel = channel_;
 	device = newDevice;
 
+	zapPending = true;
+	zapTimes = DvbZapTimes();
+	zapTimes.times[DvbZapTimes::DeviceAcquired] = deviceTime;
+	zapTimeoutTimer.start(MaximumZapTime);
 	replay();
 }
 
+const DvbZapTimes &DvbLiveView::getLastZapTimes() const
+{
+	return lastZapTimes;
+}
+
+const QMap<QString, DvbZapStatistics> &DvbLiveView::getChannelZapStatistics() const
+{
+	return channelZapStatistics;
+}
+
+const QMap<QString, DvbZapStatistics> &DvbLiveView::getDeviceZapStatistics() const
+{
+	return deviceZapStatistics;
+}
+
+void DvbLiveView::toggleZapTimesOsd()
+{
+	zapTimesOsd = !zapTimesOsd;
+
+	if (zapTimesOsd) {
+		showZapTimes();
+	}
+}
+
+void DvbLiveView::showZapTimes()
+{
+	QStringList lines;
+	lines.append(i18nc("osd", "Channel change times:"));
+
+	for (int stage = 0; stage < DvbZapTimes::StageCount; ++stage) {
+		int time = lastZapTimes.times[stage];
+
+		if (time >= 0) {
+			lines.append(i18nc("osd zap stage and time", "%1: %2 ms",
+				zapStageText(stage), time));
+		} else {
+			lines.append(i18nc("osd zap stage which was not reached", "%1: -",
+				zapStageText(stage)));
+		}
+	}
+
+	osdWidget->showText(lines.join(QLatin1String("\n")), 5000);
+}
+
 void DvbLiveView::toggleOsd()
 {
 	if (channel.constData() == NULL) {
@@ -277,11 +467,26 @@ void DvbLiveView::toggleOsd()
 }
 
 void DvbLiveView::pmtSectionChanged(const QByteArray &pmtSectionData)
+{
+	if (zapPending && (zapTimes.times[DvbZapTimes::FirstPmt] < 0)) {
+		zapTimes.times[DvbZapTimes::FirstPmt] = int(zapTimer.elapsed());
+	}
+
+	// the cached pmt of the channel is already in use (see replay())
+	if (pmtSectionData == internal->pmtSectionData) {
+		return;
+	}
+
+	updatePmtSection(pmtSectionData);
+}
+
+void DvbLiveView::updatePmtSection(const QByteArray &pmtSectionData)
 {
 	internal->pmtSectionData = pmtSectionData;
 	DvbPmtSection pmtSection(internal->pmtSectionData);
 	DvbPmtParser pmtParser(pmtSection);
 	videoPid = pmtParser.videoPid;
+	internal->setVideoPid(videoPid, pmtParser.videoStreamType);
 
 	for (int i = 0;; ++i) {
 		if (i == pmtParser.audioPids.size()) {
@@ -316,7 +521,7 @@ void DvbLiveView::pmtSectionChanged(const QByteArray &pmtSectionData)
 		device->startDescrambling(internal->pmtSectionData, this);
 	}
 
-	if (internal->timeShiftFile.isOpen()) {
+	if (tracksFixed) {
 		return;
 	}
 
@@ -352,8 +557,9 @@ void DvbLiveView::pmtSectionChanged(const QByteArray &pmtSectionData)
 
 void DvbLiveView::insertPatPmt()
 {
-	internal->buffer.append(internal->patGenerator.generatePackets());
-	internal->buffer.append(internal->pmtGenerator.generatePackets());
+	QByteArray patPmt = internal->patGenerator.generatePackets();
+	patPmt.append(internal->pmtGenerator.generatePackets());
+	internal->insertPatPmt(patPmt);
 }
 
 void DvbLiveView::deviceStateChanged()
@@ -402,35 +608,55 @@ void DvbLiveView::currentSubtitleChanged(int currentSubtitle)
 	updatePids();
 }
 
+void DvbLiveView::stopPlayback()
+{
+	if (device != NULL) {
+		stopDevice();
+		manager->releaseDevice(device, DvbManager::Shared);
+		device = NULL;
+	}
+
+	pids.clear();
+	patPmtTimer.stop();
+	osdTimer.stop();
+
+	internal->pmtSectionData.clear();
+	internal->patGenerator = DvbSectionGenerator();
+	internal->pmtGenerator = DvbSectionGenerator();
+	internal->mutex.lock();
+	internal->buffer.clear();
+	internal->mutex.unlock();
+	internal->timeShiftFile.close();
+	internal->setFileTimeShift(false);
+	internal->stopTimeShift();
+	tracksFixed = false;
+	internal->retryCounter = 0;
+	internal->updateUrl();
+	internal->dvbOsd.init(manager, DvbOsd::Off, QString(), QList<DvbSharedEpgEntry>());
+	osdWidget->hideObject();
+	// an interrupted zap would distort the statistics
+	zapPending = false;
+	zapTimeoutTimer.stop();
+}
+
 void DvbLiveView::playbackStatusChanged(MediaWidget::PlaybackStatus playbackStatus)
 {
 	switch (playbackStatus) {
 	case MediaWidget::Idle:
-		if (device != NULL) {
-			stopDevice();
-			manager->releaseDevice(device, DvbManager::Shared);
-			device = NULL;
-		}
-
-		pids.clear();
-		patPmtTimer.stop();
-		osdTimer.stop();
-
-		internal->pmtSectionData.clear();
-		internal->patGenerator = DvbSectionGenerator();
-		internal->pmtGenerator = DvbSectionGenerator();
-		internal->buffer.clear();
-		internal->timeShiftFile.close();
-		internal->retryCounter = 0;
-		internal->updateUrl();
-		internal->dvbOsd.init(manager, DvbOsd::Off, QString(), QList<DvbSharedEpgEntry>());
-		osdWidget->hideObject();
+		stopPlayback();
+		// nothing is watched anymore, so that the pre-tuned channels are useless
+		manager->getZapAccelerator()->releaseDevices();
+		internal->releaseTimeShiftFile();
 		break;
 	case MediaWidget::Playing:
 		if (internal->timeShiftFile.isOpen()) {
 			// FIXME
 			mediaWidget->play(internal);
 			mediaWidget->setPosition(pausedTime);
+		} else if (manager->isAlwaysOnTimeShift() && internal->isStreamOpen() &&
+			   !internal->isTimeShifting()) {
+			// the tracks can still be changed (only the current ones are kept)
+			startTimeShift(false);
 		}
 
 		break;
@@ -442,6 +668,17 @@ void DvbLiveView::playbackStatusChanged(MediaWidget::PlaybackStatus playbackStat
 			break;
 		}
 
+		if (internal->isStreamOpen()) {
+			// the player continues where it paused; the stream keeps the data meanwhile
+			if (!internal->isTimeShifting()) {
+				startTimeShift(true);
+			}
+
+			break;
+		}
+
+		// players without custom i/o read a growing file instead
+		internal->stopTimeShift();
 		internal->timeShiftFile.setFileName(manager->getTimeShiftFolder() + QLatin1String("/TimeShift-") +
 			QDateTime::currentDateTime().toString(QLatin1String("yyyyMMddThhmmss")) +
 			QLatin1String(".m2t"));
@@ -461,6 +698,8 @@ void DvbLiveView::playbackStatusChanged(MediaWidget::PlaybackStatus playbackStat
 			}
 		}
 
+		internal->setFileTimeShift(true);
+		tracksFixed = true;
 		updatePids();
 
 		// Use either the timeshift or the standard file URL
@@ -476,6 +715,97 @@ void DvbLiveView::playbackStatusChanged(MediaWidget::PlaybackStatus playbackStat
 	}
 }
 
+void DvbLiveView::videoOutputStarted()
+{
+	if (zapPending && (zapTimes.times[DvbZapTimes::FirstFrame] < 0)) {
+		zapTimes.times[DvbZapTimes::FirstFrame] = int(zapTimer.elapsed());
+		finishZap();
+	}
+}
+
+void DvbLiveView::finishZap()
+{
+	zapTimeoutTimer.stop();
+
+	if (!zapPending || (device == NULL)) {
+		zapPending = false;
+		return;
+	}
+
+	zapPending = false;
+
+	// the device and the demux thread report absolute timestamps
+	qint64 zapStart = zapTimer.msecsSinceReference();
+	qint64 timestamps[DvbZapTimes::StageCount];
+
+	for (int stage = 0; stage < DvbZapTimes::StageCount; ++stage) {
+		timestamps[stage] = -1;
+	}
+
+	timestamps[DvbZapTimes::Tuned] = device->getTuneTimestamp();
+	timestamps[DvbZapTimes::Locked] = device->getLockTimestamp();
+	internal->getZapTimestamps(timestamps[DvbZapTimes::FirstPacket],
+		timestamps[DvbZapTimes::FirstKeyFrame], timestamps[DvbZapTimes::FirstOutput]);
+
+	for (int stage = 0; stage < DvbZapTimes::StageCount; ++stage) {
+		// older timestamps belong to a previous zap (e.g. no tuning was necessary)
+		if (timestamps[stage] >= zapStart) {
+			zapTimes.times[stage] = int(timestamps[stage] - zapStart);
+		}
+	}
+
+	if (zapTimes.times[DvbZapTimes::FirstOutput] < 0) {
+		qCDebug(logDvb, "Zap to %s didn't produce any output", qPrintable(channel->name));
+		return;
+	}
+
+	lastZapTimes = zapTimes;
+	channelZapStatistics[channel->name].add(zapTimes);
+	deviceZapStatistics[device->getDeviceId()].add(zapTimes);
+
+	QStringList times;
+
+	for (int stage = 0; stage < DvbZapTimes::StageCount; ++stage) {
+		times.append(DvbZapTimes::stageName(stage) + QLatin1Char('=') +
+			QString::number(zapTimes.times[stage]));
+	}
+
+	qCDebug(logDvb, "Zap to %s (ms): %s", qPrintable(channel->name),
+		qPrintable(times.join(QLatin1String(", "))));
+
+	if (zapTimesOsd) {
+		showZapTimes();
+	}
+}
+
+void DvbLiveView::startTimeShift(bool fixTracks)
+{
+	qint64 maximumSize = (qint64(manager->getTimeShiftSize()) * 1024 * 1024);
+	QString fileName = QLatin1String("/TimeShift-") +
+		QDateTime::currentDateTime().toString(QLatin1String("yyyyMMddThhmmss")) +
+		QLatin1String(".m2t");
+
+	if (!internal->startTimeShift(manager->getTimeShiftFolder() + fileName, maximumSize) &&
+	    !internal->startTimeShift(QDir::homePath() + fileName, maximumSize)) {
+		return;
+	}
+
+	mediaWidget->seekableChanged();
+
+	if (!fixTracks) {
+		return;
+	}
+
+	// all audio pids are kept; don't allow changes after starting time shift
+	tracksFixed = true;
+	updatePids();
+	internal->audioStreams.clear();
+	internal->currentAudioStream = -1;
+	mediaWidget->audioStreamsChanged();
+	internal->currentSubtitle = -1;
+	mediaWidget->subtitlesChanged();
+}
+
 void DvbLiveView::showOsd()
 {
 	if (internal->dvbOsd.level == DvbOsd::Off) {
@@ -528,13 +858,12 @@ void DvbLiveView::updatePids(bool forcePatPmtUpdate)
 	QSet<int> newPids;
 	int pcrPid = pmtSection.pcrPid();
 	bool updatePatPmt = forcePatPmtUpdate;
-	bool isTimeShifting = internal->timeShiftFile.isOpen();
 
 	if (videoPid != -1) {
 		newPids.insert(videoPid);
 	}
 
-	if (!isTimeShifting) {
+	if (!tracksFixed) {
 		if (audioPid != -1) {
 			newPids.insert(audioPid);
 		}
@@ -582,8 +911,628 @@ void DvbLiveView::updatePids(bool forcePatPmtUpdate)
 	}
 }
 
+DvbLiveViewStream::DvbLiveViewStream() : writePosition(0), generation(0), opened(0),
+	interrupted(0), readerWaiting(0), readPosition(0), readGeneration(0), droppedBytes(0),
+	currentReadPosition(0), pendingSeekPosition(-1), randomAccessIndex(0),
+	randomAccessSize(0), videoPid(-1), pcrPid(-1), lastPcr(-1), streamTime(0),
+	timeShifting(false), timeShiftFileFd(-1), timeShiftFileSize(0), timeShiftAllocated(false),
+	timeShiftFd(-1), timeShiftSize(0), timeShiftBegin(0), timeShiftEnd(0), timeShiftStopped(0)
+{
+	ring = new char[Capacity];
+}
+
+DvbLiveViewStream::~DvbLiveViewStream()
+{
+	releaseTimeShiftFile();
+	delete[] ring;
+}
+
+void DvbLiveViewStream::reset()
+{
+	// the file stays allocated (see startTimeShift())
+	stopTimeShift();
+
+	// a reader of the old data continues with the new data (see read()); it's only
+	// stopped by interrupt(), so that the player doesn't see an end of stream; the
+	// generation changes first, so that a reader never pairs the old read position
+	// with the new write position without noticing
+	randomAccessMutex.lock();
+	generation.fetchAndAddOrdered(1);
+	writePosition.storeRelease(0);
+	pendingSeekPosition.storeRelease(-1);
+	randomAccessIndex = 0;
+	randomAccessSize = 0;
+	timeEntries.clear();
+	randomAccessMutex.unlock();
+
+	pcrPid = -1;
+	lastPcr = -1;
+	streamTime = 0;
+
+	QMutexLocker locker(&waitMutex);
+	dataAvailable.wakeAll();
+}
+
+void DvbLiveViewStream::setVideoPid(int videoPid_)
+{
+	videoPid = videoPid_;
+}
+
+void DvbLiveViewStream::write(const char *data, int size)
+{
+	qint64 position = writePosition.loadAcquire();
+	randomAccessMutex.lock();
+
+	for (int offset = 0; offset < size; offset += 188) {
+		const char *packet = (data + offset);
+
+		if (((packet[3] & 0x20) == 0) || (quint8(packet[4]) == 0)) {
+			continue;
+		}
+
+		int pid = (((quint8(packet[1]) << 8) | quint8(packet[2])) & ((1 << 13) - 1));
+
+		if ((quint8(packet[4]) >= 7) && ((packet[5] & 0x10) != 0)) {
+			if (pcrPid < 0) {
+				pcrPid = pid;
+			}
+
+			if (pid == pcrPid) {
+				// pcr base; units of 90 kHz
+				const unsigned char *pcrData =
+					reinterpret_cast<const unsigned char *>(packet + 6);
+				qint64 pcr = ((qint64(pcrData[0]) << 25) | (pcrData[1] << 17) |
+					(pcrData[2] << 9) | (pcrData[3] << 1) | (pcrData[4] >> 7));
+
+				if (lastPcr >= 0) {
+					// 33 bit wrap around; larger steps are discontinuities
+					qint64 delta = ((pcr - lastPcr) & ((Q_INT64_C(1) << 33) - 1));
+
+					if (delta <= (90000 * 10)) {
+						streamTime += delta;
+					}
+				}
+
+				lastPcr = pcr;
+
+				// fallback for streams without random access indicators
+				if (timeEntries.isEmpty() ||
+				    (((streamTime / 90) - timeEntries.last().time) >= 5000)) {
+					addTimeEntry(position + offset);
+				}
+			}
+		}
+
+		// the random access indicator is set for the start of a key frame; only the video
+		// is decoded from there on (other pids are used for streams without video)
+		if (((packet[5] & 0x40) != 0) && ((videoPid < 0) || (pid == videoPid))) {
+			randomAccessPositions[randomAccessIndex] = (position + offset);
+			randomAccessIndex = ((randomAccessIndex + 1) % RandomAccessCount);
+
+			if (randomAccessSize < RandomAccessCount) {
+				++randomAccessSize;
+			}
+
+			if ((lastPcr >= 0) && (timeEntries.isEmpty() ||
+			    (((streamTime / 90) - timeEntries.last().time) >= 1000))) {
+				addTimeEntry(position + offset);
+			}
+		}
+	}
+
+	// data beyond 'Capacity' overwrites the oldest data
+	if (size > Capacity) {
+		position += (size - Capacity);
+		data += (size - Capacity);
+		size = Capacity;
+	}
+
+	int ringOffset = int(position % Capacity);
+	int amount = qMin(size, Capacity - ringOffset);
+	memcpy(ring + ringOffset, data, amount);
+
+	if (amount < size) {
+		memcpy(ring, data + amount, size - amount);
+	}
+
+	writePosition.storeRelease(position + size);
+
+	qint64 minimumPosition = getMinimumPosition();
+
+	while (!timeEntries.isEmpty() && (timeEntries.first().position < minimumPosition)) {
+		timeEntries.removeFirst();
+	}
+
+	randomAccessMutex.unlock();
+
+	if (readerWaiting.loadAcquire() != 0) {
+		QMutexLocker locker(&waitMutex);
+		dataAvailable.wakeAll();
+	}
+}
+
+void DvbLiveViewStream::addTimeEntry(qint64 position)
+{
+	TimeEntry entry;
+	entry.position = position;
+	entry.time = (streamTime / 90);
+	timeEntries.append(entry);
+}
+
+qint64 DvbLiveViewStream::getMinimumPosition() const
+{
+	// writer side or timeShiftMutex is held
+	qint64 minimumPosition = (writePosition.loadAcquire() - (Capacity - (Capacity / 8)));
+
+	if (timeShiftFd >= 0) {
+		// the block which is being written may already be overwritten
+		qint64 timeShiftMinimum = qMax(timeShiftBegin.loadAcquire(),
+			timeShiftEnd.loadAcquire() - timeShiftSize + BlockSize);
+		minimumPosition = qMin(minimumPosition, timeShiftMinimum);
+	}
+
+	return qMax(minimumPosition, Q_INT64_C(0));
+}
+
+bool DvbLiveViewStream::startTimeShift(const QString &fileName, qint64 maximumSize)
+{
+	Q_ASSERT(!timeShifting);
+	qint64 size = qMax(maximumSize - (maximumSize % BlockSize), qint64(16 * BlockSize));
+
+	// allocating a large file takes a while; it's reused until the size changes
+	if ((timeShiftFileFd < 0) || (timeShiftFileSize != size)) {
+		releaseTimeShiftFile();
+		QByteArray encodedFileName = QFile::encodeName(fileName);
+		int fd = ::open(encodedFileName.constData(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+			0600);
+
+		if (fd < 0) {
+			qCWarning(logDvb, "Cannot open time shift file %s: error %d",
+				qPrintable(fileName), errno);
+			return false;
+		}
+
+		// the file is only accessed through the descriptor, so it vanishes when it's closed
+		unlink(encodedFileName.constData());
+		timeShiftFileFd = fd;
+		timeShiftFileSize = size;
+		timeShiftAllocated = false;
+	}
+
+	// the recent data which is still in the ring is kept as well
+	qint64 beginPosition = qMax(writePosition.loadAcquire() - (Capacity / 2), Q_INT64_C(0));
+	timeShiftBegin.storeRelease(beginPosition);
+	timeShiftEnd.storeRelease(beginPosition);
+	timeShiftStopped.storeRelease(0);
+
+	timeShiftMutex.lock();
+	timeShiftFd = timeShiftFileFd;
+	timeShiftSize = timeShiftFileSize;
+	timeShiftMutex.unlock();
+
+	timeShifting = true;
+	qCDebug(logDvb, "Time shift with at most %lld bytes", timeShiftSize);
+	start();
+	return true;
+}
+
+void DvbLiveViewStream::stopTimeShift()
+{
+	if (!timeShifting) {
+		return;
+	}
+
+	stopMutex.lock();
+	timeShiftStopped.storeRelease(1);
+	stopCondition.wakeAll();
+	stopMutex.unlock();
+	wait();
+
+	// only the window is closed; the file is kept for the next start
+	timeShiftMutex.lock();
+	timeShiftFd = -1;
+	timeShiftSize = 0;
+	timeShiftMutex.unlock();
+
+	timeShifting = false;
+	pendingSeekPosition.storeRelease(-1);
+}
+
+void DvbLiveViewStream::releaseTimeShiftFile()
+{
+	stopTimeShift();
+
+	if (timeShiftFileFd >= 0) {
+		::close(timeShiftFileFd);
+		timeShiftFileFd = -1;
+		timeShiftFileSize = 0;
+		timeShiftAllocated = false;
+	}
+}
+
+void DvbLiveViewStream::getTimeShiftTimes(int &currentTime, int &totalTime)
+{
+	QMutexLocker locker(&randomAccessMutex);
+
+	if (timeEntries.isEmpty()) {
+		currentTime = 0;
+		totalTime = 0;
+		return;
+	}
+
+	qint64 position = pendingSeekPosition.loadAcquire();
+
+	if (position < 0) {
+		position = currentReadPosition.loadAcquire();
+	}
+
+	// entries before the minimum position are already removed (see write())
+	qint64 beginTime = timeEntries.first().time;
+	qint64 time = beginTime;
+
+	for (int i = (timeEntries.size() - 1); i >= 0; --i) {
+		if (timeEntries.at(i).position <= position) {
+			time = timeEntries.at(i).time;
+			break;
+		}
+	}
+
+	totalTime = int((streamTime / 90) - beginTime);
+	currentTime = qBound(0, int(time - beginTime), totalTime);
+}
+
+void DvbLiveViewStream::seekTimeShift(int time)
+{
+	QMutexLocker locker(&randomAccessMutex);
+
+	if (timeEntries.isEmpty()) {
+		return;
+	}
+
+	// the last entry at or before the requested time
+	qint64 targetTime = (timeEntries.first().time + time);
+	qint64 position = timeEntries.first().position;
+
+	for (int i = (timeEntries.size() - 1); i >= 0; --i) {
+		if (timeEntries.at(i).time <= targetTime) {
+			position = timeEntries.at(i).position;
+			break;
+		}
+	}
+
+	// applied by the reader (see read())
+	pendingSeekPosition.storeRelease(position);
+}
+
+bool DvbLiveViewStream::waitFor(int msecs)
+{
+	QMutexLocker locker(&stopMutex);
+
+	if (timeShiftStopped.loadAcquire() == 0) {
+		stopCondition.wait(&stopMutex, msecs);
+	}
+
+	return (timeShiftStopped.loadAcquire() == 0);
+}
+
+void DvbLiveViewStream::run()
+{
+	// timeShiftFd and timeShiftSize don't change while the thread is running
+	if (!timeShiftAllocated) {
+		int error = posix_fallocate(timeShiftFd, 0, timeShiftSize);
+
+		if (error != 0) {
+			qCWarning(logDvb, "Cannot allocate %lld bytes for time shift: error %d",
+				timeShiftSize, error);
+		}
+
+		timeShiftAllocated = true;
+	}
+
+	QByteArray blockBuffer(BlockSize, Qt::Uninitialized);
+	char *block = blockBuffer.data();
+	qint64 position = timeShiftEnd.loadAcquire();
+
+	while (timeShiftStopped.loadAcquire() == 0) {
+		qint64 currentWritePosition = writePosition.loadAcquire();
+
+		// collect some data instead of writing every few packets
+		if ((currentWritePosition - position) < BlockSize) {
+			if (!waitFor(100)) {
+				break;
+			}
+
+			currentWritePosition = writePosition.loadAcquire();
+
+			if (currentWritePosition == position) {
+				continue;
+			}
+		}
+
+		qint64 fileOffset = (position % timeShiftSize);
+		int amount = int(qMin(qMin(currentWritePosition - position, qint64(BlockSize)),
+			timeShiftSize - fileOffset));
+		int ringOffset = int(position % Capacity);
+		int firstAmount = qMin(amount, Capacity - ringOffset);
+		memcpy(block, ring + ringOffset, firstAmount);
+
+		if (firstAmount < amount) {
+			memcpy(block + firstAmount, ring, amount - firstAmount);
+		}
+
+		// the writer may have overwritten the data in the meantime
+		currentWritePosition = writePosition.loadAcquire();
+
+		if ((currentWritePosition - Capacity) > position) {
+			qint64 newPosition = (currentWritePosition - (Capacity / 2));
+			qCWarning(logDvb, "Time shift file is too slow; skipped %lld bytes",
+				newPosition - position);
+			position = newPosition;
+			timeShiftBegin.storeRelease(position);
+			timeShiftEnd.storeRelease(position);
+			continue;
+		}
+
+		const char *data = block;
+		int size = amount;
+
+		while (size > 0) {
+			int bytesWritten = int(pwrite(timeShiftFd, data, size, fileOffset));
+
+			if (bytesWritten < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				qCWarning(logDvb, "Cannot write to time shift file: error %d", errno);
+				return;
+			}
+
+			data += bytesWritten;
+			size -= bytesWritten;
+			fileOffset += bytesWritten;
+		}
+
+		position += amount;
+		timeShiftEnd.storeRelease(position);
+	}
+}
+
+bool DvbLiveViewStream::open()
+{
+	readGeneration = generation.loadAcquire();
+	droppedBytes = 0;
+	pendingSeekPosition.storeRelease(-1);
+	interrupted.storeRelease(0);
+	opened.storeRelease(1);
+	startAtLatestRandomAccessPoint();
+	return true;
+}
+
+void DvbLiveViewStream::startAtLatestRandomAccessPoint()
+{
+	// the player shows a picture right away and the data before is of no use
+	randomAccessMutex.lock();
+	// consistent with the random access points (see reset())
+	qint64 currentWritePosition = writePosition.loadAcquire();
+	qint64 minimumPosition = qMax(currentWritePosition - (Capacity - (Capacity / 8)),
+		Q_INT64_C(0));
+	readPosition = (minimumPosition - (minimumPosition % 188));
+
+	if (randomAccessSize > 0) {
+		qint64 position = randomAccessPositions[
+			(randomAccessIndex - 1 + RandomAccessCount) % RandomAccessCount];
+
+		if ((position >= minimumPosition) && (position <= currentWritePosition)) {
+			readPosition = position;
+		}
+	}
+
+	randomAccessMutex.unlock();
+	currentReadPosition.storeRelease(readPosition);
+}
+
+bool DvbLiveViewStream::isAvailable() const
+{
+	return ((interrupted.loadAcquire() != 0) || (generation.loadAcquire() != readGeneration) ||
+		(writePosition.loadAcquire() > readPosition));
+}
+
+int DvbLiveViewStream::read(char *data, int size)
+{
+	while (true) {
+		if (!isAvailable()) {
+			QMutexLocker locker(&waitMutex);
+			readerWaiting.storeRelease(1);
+
+			if (!isAvailable()) {
+				dataAvailable.wait(&waitMutex, 100);
+			}
+
+			readerWaiting.storeRelease(0);
+			continue;
+		}
+
+		if (interrupted.loadAcquire() != 0) {
+			return 0;
+		}
+
+		if (generation.loadAcquire() != readGeneration) {
+			// the writer has been reset (zap); the player has to resync anyway
+			readGeneration = generation.loadAcquire();
+			pendingSeekPosition.storeRelease(-1);
+			startAtLatestRandomAccessPoint();
+			continue;
+		}
+
+		qint64 seekPosition = pendingSeekPosition.fetchAndStoreOrdered(-1);
+
+		if (seekPosition >= 0) {
+			readPosition = seekPosition;
+		}
+
+		qint64 currentWritePosition = writePosition.loadAcquire();
+
+		// keep some distance to the writer
+		if ((currentWritePosition - readPosition) > (Capacity - (Capacity / 8))) {
+			// older data may still be in the time shift file
+			int amount = readTimeShift(data, size);
+
+			if (amount > 0) {
+				readPosition += amount;
+				currentReadPosition.storeRelease(readPosition);
+				return amount;
+			}
+
+			skipToRandomAccessPoint(currentWritePosition);
+			continue;
+		}
+
+		if (currentWritePosition <= readPosition) {
+			// nothing to read or a reset in the meantime (the generation has changed)
+			continue;
+		}
+
+		int amount = int(qMin(qint64(size), currentWritePosition - readPosition));
+		int ringOffset = int(readPosition % Capacity);
+		int firstAmount = qMin(amount, Capacity - ringOffset);
+		memcpy(data, ring + ringOffset, firstAmount);
+
+		if (firstAmount < amount) {
+			memcpy(data + firstAmount, ring, amount - firstAmount);
+		}
+
+		// the writer may have overwritten the data in the meantime
+		if (((writePosition.loadAcquire() - Capacity) > readPosition) ||
+		    (generation.loadAcquire() != readGeneration)) {
+			continue;
+		}
+
+		readPosition += amount;
+		currentReadPosition.storeRelease(readPosition);
+		return amount;
+	}
+}
+
+int DvbLiveViewStream::readTimeShift(char *data, int size)
+{
+	QMutexLocker locker(&timeShiftMutex);
+	qint64 end = timeShiftEnd.loadAcquire();
+
+	if ((timeShiftFd < 0) || (readPosition < getMinimumPosition()) || (readPosition >= end)) {
+		return -1;
+	}
+
+	qint64 fileOffset = (readPosition % timeShiftSize);
+	int amount = int(qMin(qMin(qint64(size), end - readPosition), timeShiftSize - fileOffset));
+	int bytesRead = int(pread(timeShiftFd, data, amount, fileOffset));
+
+	if (bytesRead <= 0) {
+		if (bytesRead < 0) {
+			qCWarning(logDvb, "Cannot read from time shift file: error %d", errno);
+		}
+
+		return -1;
+	}
+
+	// the thread may have overwritten the data in the meantime
+	if (readPosition < getMinimumPosition()) {
+		return -1;
+	}
+
+	return bytesRead;
+}
+
+void DvbLiveViewStream::skipToRandomAccessPoint(qint64 writePosition_)
+{
+	qint64 newPosition = -1;
+
+	// a reader which fell out of the time shift window continues with the oldest data
+	timeShiftMutex.lock();
+
+	if ((timeShiftFd >= 0) && (readPosition < timeShiftEnd.loadAcquire())) {
+		// leave some room, so that the time shift thread doesn't catch up immediately
+		qint64 minimumPosition = (getMinimumPosition() + (timeShiftSize / 16));
+		randomAccessMutex.lock();
+
+		foreach (const TimeEntry &entry, timeEntries) {
+			if ((entry.position >= minimumPosition) && (entry.position > readPosition)) {
+				newPosition = entry.position;
+				break;
+			}
+		}
+
+		randomAccessMutex.unlock();
+	}
+
+	timeShiftMutex.unlock();
+
+	if (newPosition < 0) {
+		// land in the middle of the buffered data, so that there's time to catch up
+		qint64 minimumPosition = (writePosition_ - (Capacity / 2));
+		newPosition = writePosition_;
+
+		randomAccessMutex.lock();
+
+		for (int i = randomAccessSize; i > 0; --i) {
+			qint64 position = randomAccessPositions[
+				(randomAccessIndex - i + RandomAccessCount) % RandomAccessCount];
+
+			if ((position >= minimumPosition) && (position > readPosition)) {
+				newPosition = position;
+				break;
+			}
+		}
+
+		randomAccessMutex.unlock();
+
+		if (newPosition == writePosition_) {
+			// no random access point; continue at a packet boundary
+			newPosition = qMax(minimumPosition, readPosition);
+			newPosition -= (newPosition % 188);
+		}
+	}
+
+	if (readPosition > 0) {
+		droppedBytes += (newPosition - readPosition);
+		qCWarning(logDvb, "Player is too slow; skipped %lld bytes (%lld bytes in total)",
+			newPosition - readPosition, droppedBytes);
+	}
+
+	readPosition = newPosition;
+}
+
+bool DvbLiveViewStream::seek(qint64 position)
+{
+	QMutexLocker locker(&timeShiftMutex);
+
+	// only the buffered window can be reached
+	if ((position < getMinimumPosition()) || (position > writePosition.loadAcquire())) {
+		return false;
+	}
+
+	readPosition = position;
+	currentReadPosition.storeRelease(readPosition);
+	return true;
+}
+
+void DvbLiveViewStream::close()
+{
+	opened.storeRelease(0);
+}
+
+void DvbLiveViewStream::interrupt()
+{
+	interrupted.storeRelease(1);
+	QMutexLocker locker(&waitMutex);
+	dataAvailable.wakeAll();
+}
+
 DvbLiveViewInternal::DvbLiveViewInternal(QObject *parent) : QObject(parent), mediaWidget(NULL),
-	retryCounter(0), readFd(-1), writeFd(-1)
+	emptyBuffer(true), retryCounter(0), stream(new DvbLiveViewStream()), readFd(-1),
+	writeFd(-1), notifier(NULL), droppedBuffers(0), fileTimeShift(false),
+	waitingForKeyFrame(false), firstPacketTimestamp(-1),
+	firstKeyFrameTimestamp(-1), firstOutputTimestamp(-1)
 {
 	fileName = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation) + QLatin1String("/dvbpipe.m2t");
 	QFile::remove(fileName);
@@ -630,7 +1579,23 @@ DvbLiveViewInternal::~DvbLiveViewInternal()
 void DvbLiveViewInternal::resetPipe()
 {
 	retryCounter = 0;
-	notifier->setEnabled(false);
+
+	// the fifo is only a fallback (see processBuffers())
+	if (notifier != NULL) {
+		notifier->setEnabled(false);
+	}
+
+	QMutexLocker locker(&mutex);
+	stream->reset();
+	pendingBuffers.clear();
+	droppedBuffers = 0;
+	// the player can't start with the middle of a group of pictures anyway
+	waitingForKeyFrame = true;
+	preTunedData.clear();
+	zapTimer.start();
+	firstPacketTimestamp = -1;
+	firstKeyFrameTimestamp = -1;
+	firstOutputTimestamp = -1;
 
 	if (!buffers.isEmpty()) {
 		buffer = buffers.at(0);
@@ -650,6 +1615,56 @@ void DvbLiveViewInternal::resetPipe()
 	buffer.clear();
 }
 
+void DvbLiveViewInternal::processBuffers()
+{
+	mutex.lock();
+	QList<QByteArray> newBuffers = pendingBuffers;
+	pendingBuffers.clear();
+	int dropped = droppedBuffers;
+	droppedBuffers = 0;
+	mutex.unlock();
+
+	if (dropped > 0) {
+		qCWarning(logDvb, "Dropped %d buffers; the main thread didn't keep up", dropped);
+	}
+
+	if (!timeShiftFile.isOpen()) {
+		if (stream->isOpen()) {
+			// the player reads the stream directly (see writeBuffer())
+			buffers.clear();
+
+			if (notifier != NULL) {
+				notifier->setEnabled(false);
+			}
+
+			if (emptyBuffer) {
+				startTime = QTime::currentTime();
+				emptyBuffer = false;
+			}
+		} else if ((writeFd >= 0) && !newBuffers.isEmpty()) {
+			buffers.append(newBuffers);
+			writeToPipe();
+			if (emptyBuffer) {
+				startTime = QTime::currentTime();
+				emptyBuffer = false;
+			}
+		}
+	} else {
+		if (notifier != NULL) {
+			notifier->setEnabled(false);
+		}
+
+		foreach (const QByteArray &newBuffer, newBuffers) {
+			timeShiftFile.write(newBuffer);
+		}
+
+		if (emptyBuffer) {
+			startTime = QTime::currentTime();
+			emptyBuffer = false;
+		}
+	}
+}
+
 void DvbLiveViewInternal::writeToPipe()
 {
 	if (buffers.isEmpty()) {
@@ -699,6 +1714,11 @@ void DvbLiveViewInternal::writeToPipe()
 
 void DvbLiveViewInternal::validateCurrentTotalTime(int &currentTime, int &totalTime) const
 {
+	if (stream->isTimeShifting()) {
+		stream->getTimeShiftTimes(currentTime, totalTime);
+		return;
+	}
+
 	if (emptyBuffer)
 		return;
 
@@ -711,32 +1731,142 @@ void DvbLiveViewInternal::validateCurrentTotalTime(int &currentTime, int &totalT
 }
 
 
-void DvbLiveViewInternal::processData(const char data[188])
+void DvbLiveViewInternal::setPreTunedData(const QByteArray &data)
 {
-	buffer.append(data, 188);
+	if (data.isEmpty()) {
+		return;
+	}
 
-	if (buffer.size() < (87 * 188)) {
+	QMutexLocker locker(&mutex);
+	// starts with a key frame (see DvbZapAccelerator)
+	preTunedData = data;
+	waitingForKeyFrame = false;
+	firstKeyFrameTimestamp = currentTimestamp();
+
+	if (firstPacketTimestamp < 0) {
+		firstPacketTimestamp = firstKeyFrameTimestamp;
+	}
+}
+
+void DvbLiveViewInternal::insertPatPmt(const QByteArray &patPmt)
+{
+	QMutexLocker locker(&mutex);
+
+	if (preTunedData.isEmpty()) {
+		buffer.append(patPmt);
 		return;
 	}
 
-	if (!timeShiftFile.isOpen()) {
-		if (writeFd >= 0) {
-			buffers.append(buffer);
-			writeToPipe();
-			if (emptyBuffer) {
-				startTime = QTime::currentTime();
-				emptyBuffer = false;
-			}
+	// the pre-tuned data needs the pat / pmt in front of it; the packets which were
+	// received in the meantime are newer (they're held back, see processPackets())
+	QByteArray data = patPmt;
+	data.append(preTunedData);
+	preTunedData.clear();
+	data.append(buffer);
+	buffer.clear();
+	buffer.reserve(87 * 188);
+	writeBuffer(data);
+}
+
+void DvbLiveViewInternal::getZapTimestamps(qint64 &firstPacket, qint64 &firstKeyFrame,
+	qint64 &firstOutput)
+{
+	QMutexLocker locker(&mutex);
+	firstPacket = firstPacketTimestamp;
+	firstKeyFrame = firstKeyFrameTimestamp;
+	firstOutput = firstOutputTimestamp;
+}
+
+qint64 DvbLiveViewInternal::currentTimestamp() const
+{
+	return (zapTimer.msecsSinceReference() + zapTimer.elapsed());
+}
+
+void DvbLiveViewInternal::setVideoPid(int videoPid, int videoStreamType)
+{
+	QMutexLocker locker(&mutex);
+	stream->setVideoPid(videoPid);
+	keyFrameDetector.setVideoPid(videoPid, videoStreamType);
+}
+
+bool DvbLiveViewInternal::checkKeyFrame(const char *packet)
+{
+	// elementary stream data is held back until the first key frame (mutex is held)
+	if (keyFrameDetector.getVideoPid() >= 0) {
+		// the device may need a while for tuning; only the time since the first packet counts
+		qint64 delay = (currentTimestamp() - firstPacketTimestamp);
+
+		if (keyFrameDetector.isKeyFrame(packet)) {
+			qCDebug(logDvb, "First key frame after %lld ms", zapTimer.elapsed());
+		} else if (delay < MaximumKeyFrameDelay) {
+			return false;
+		} else {
+			qCDebug(logDvb, "No key frame found within %d ms", int(MaximumKeyFrameDelay));
 		}
-	} else {
-		notifier->setEnabled(false);
-		timeShiftFile.write(buffer); // FIXME avoid buffer reallocation
-		if (emptyBuffer) {
-			startTime = QTime::currentTime();
-			emptyBuffer = false;
+	}
+
+	waitingForKeyFrame = false;
+	firstKeyFrameTimestamp = currentTimestamp();
+	return true;
+}
+
+void DvbLiveViewInternal::processData(const char data[188])
+{
+	processPackets(&data, 1);
+}
+
+void DvbLiveViewInternal::processPackets(const char *const *packets, int count)
+{
+	QMutexLocker locker(&mutex);
+
+	if ((firstPacketTimestamp < 0) && (count > 0)) {
+		firstPacketTimestamp = currentTimestamp();
+	}
+
+	for (int i = 0; i < count; ++i) {
+		if (waitingForKeyFrame && !checkKeyFrame(packets[i])) {
+			continue;
+		}
+
+		buffer.append(packets[i], 188);
+
+		// the pre-tuned data goes first (see insertPatPmt())
+		if ((buffer.size() >= (87 * 188)) && preTunedData.isEmpty()) {
+			writeBuffer(buffer);
+			buffer.clear();
+			buffer.reserve(87 * 188);
 		}
 	}
+}
 
-	buffer.clear();
-	buffer.reserve(87 * 188);
+void DvbLiveViewInternal::writeBuffer(const QByteArray &data)
+{
+	// the ring is written right here, so that a busy main thread doesn't delay the player
+	for (int offset = 0; offset < data.size(); offset += (87 * 188)) {
+		// the pre-tuned data is large; a single write mustn't skip the reader margin
+		stream->write(data.constData() + offset, qMin(data.size() - offset, 87 * 188));
+	}
+
+	bool notify = false;
+
+	if (firstOutputTimestamp < 0) {
+		firstOutputTimestamp = currentTimestamp();
+		notify = true;
+	}
+
+	// the fifo and the time shift file are handled in the main thread
+	if (fileTimeShift || !stream->isOpen()) {
+		if (pendingBuffers.size() >= MaximumPendingBuffers) {
+			// whole packets; the oldest data is of the least use
+			pendingBuffers.removeFirst();
+			++droppedBuffers;
+		}
+
+		notify = (notify || pendingBuffers.isEmpty());
+		pendingBuffers.append(data);
+	}
+
+	if (notify) {
+		QMetaObject::invokeMethod(this, "processBuffers", Qt::QueuedConnection);
+	}
 }
@@ -21,6 +21,8 @@
 #ifndef DVBLIVEVIEW_H
 #define DVBLIVEVIEW_H
 
+#include <QElapsedTimer>
+#include <QMap>
 #include <QTimer>
 #include "../mediawidget.h"
 #include "dvbchannel.h"
@@ -29,6 +31,64 @@ class DvbDevice;
 class DvbLiveViewInternal;
 class DvbManager;
 
+// times of the stages of a channel change in ms since the request
+
+class DvbZapTimes
+{
+public:
+	enum Stage {
+		DeviceAcquired,
+		Tuned, // only if the transponder had to be tuned
+		Locked,
+		FirstPacket,
+		FirstPmt,
+		FirstKeyFrame, // first packet passed on (see DvbLiveViewInternal::checkKeyFrame())
+		FirstOutput, // first data written to the player
+		FirstFrame, // first picture displayed (only reported by some backends)
+		StageCount
+	};
+
+	DvbZapTimes();
+	~DvbZapTimes() { }
+
+	static QString stageName(int stage); // not translated; for d-bus and debug output
+
+	int times[StageCount]; // -1 if the stage wasn't reached
+};
+
+// per stage histograms of all zaps to a channel or with a device
+
+class DvbZapStatistics
+{
+public:
+	enum {
+		BucketCount = 12
+	};
+
+	class Histogram
+	{
+	public:
+		Histogram();
+		~Histogram() { }
+
+		int count;
+		qint64 sum;
+		int minimum;
+		int maximum;
+		int buckets[BucketCount];
+	};
+
+	DvbZapStatistics() { }
+	~DvbZapStatistics() { }
+
+	void add(const DvbZapTimes &zapTimes);
+
+	// upper limit (ms, exclusive) of a bucket; -1 for the last one
+	static int bucketLimit(int bucket);
+
+	Histogram histograms[DvbZapTimes::StageCount];
+};
+
 class DvbLiveView : public QObject
 {
 	Q_OBJECT
@@ -41,8 +101,13 @@ public:
 
 	void playChannel(const DvbSharedChannel &channel_);
 
+	const DvbZapTimes &getLastZapTimes() const;
+	const QMap<QString, DvbZapStatistics> &getChannelZapStatistics() const; // by channel name
+	const QMap<QString, DvbZapStatistics> &getDeviceZapStatistics() const; // by device id
+
 public slots:
 	void toggleOsd();
+	void toggleZapTimesOsd();
 
 signals:
 	void previous();
@@ -60,11 +125,21 @@ private slots:
 	void replay();
 	void playbackFinished();
 	void playbackStatusChanged(MediaWidget::PlaybackStatus playbackStatus);
+	void videoOutputStarted();
+	void finishZap();
 
 private:
+	enum {
+		MaximumZapTime = 10000 // ms; zaps without a displayed picture are finished afterwards
+	};
+
 	void startDevice();
 	void stopDevice();
+	void stopPlayback();
+	void updatePmtSection(const QByteArray &pmtSectionData);
 	void updatePids(bool forcePatPmtUpdate = false);
+	void startTimeShift(bool fixTracks);
+	void showZapTimes();
 
 	DvbManager *manager;
 	MediaWidget *mediaWidget;
@@ -76,6 +151,7 @@ private:
 	QList<int> pids;
 	QTimer patPmtTimer;
 	QTimer osdTimer;
+	QTimer zapTimeoutTimer;
 
 	int videoPid;
 	int audioPid;
@@ -83,6 +159,15 @@ private:
 	int pausedTime;
 	QList<int> audioPids;
 	QList<int> subtitlePids;
+	bool tracksFixed; // all audio pids are passed on and can't be changed (time shift)
+
+	bool zapPending;
+	QElapsedTimer zapTimer; // started by playChannel()
+	DvbZapTimes zapTimes;
+	DvbZapTimes lastZapTimes;
+	bool zapTimesOsd;
+	QMap<QString, DvbZapStatistics> channelZapStatistics;
+	QMap<QString, DvbZapStatistics> deviceZapStatistics;
 };
 
 #endif /* DVBLIVEVIEW_H */
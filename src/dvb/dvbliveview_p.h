@@ -21,7 +21,12 @@
 #ifndef DVBLIVEVIEW_P_H
 #define DVBLIVEVIEW_P_H
 
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
 #include "../mediawidget.h"
 #include "../osdwidget.h"
 #include "dvbepg.h"
@@ -56,6 +61,121 @@ private:
 	DvbManager *manager;
 };
 
+/*
+ * bounded ring between the live view (writer, demux thread) and the player (reader, thread
+ * of the backend); positions are counted in bytes since reset() and the last 'Capacity'
+ * bytes can be read again (seeking); a reader which falls behind is moved to the next
+ * random access point instead of blocking the writer
+ *
+ * the writer side (including reset() and starting / stopping time shift in the main thread)
+ * is serialized by the mutex of DvbLiveViewInternal
+ *
+ * time shift extends the window: a thread copies the ring into a preallocated circular
+ * file of fixed size, which the reader uses for data that has already left the ring;
+ * a time index (pcr based, preferably at random access points) maps stream times to
+ * positions for seeking
+ */
+
+class DvbLiveViewStream : public QThread, public MediaStream
+{
+public:
+	DvbLiveViewStream();
+	~DvbLiveViewStream();
+
+	// writer side
+	void reset();
+	void setVideoPid(int videoPid_); // random access points are taken from this pid
+	void write(const char *data, int size); // whole packets
+
+	bool isOpen() const
+	{
+		return (opened.loadAcquire() != 0);
+	}
+
+	bool startTimeShift(const QString &fileName, qint64 maximumSize);
+	void stopTimeShift(); // the file is kept, so that starting again is cheap
+	void releaseTimeShiftFile();
+
+	bool isTimeShifting() const
+	{
+		return timeShifting;
+	}
+
+	// times in ms relative to the oldest data which can be reached
+	void getTimeShiftTimes(int &currentTime, int &totalTime);
+	void seekTimeShift(int time);
+
+	// reader side
+	bool open();
+	int read(char *data, int size);
+	bool seek(qint64 position);
+	void close();
+	void interrupt();
+
+private:
+	enum {
+		Capacity = 188 * 128 * 1024, // 24 MiB; about half a minute of hd video
+		RandomAccessCount = 256,
+		BlockSize = 188 * 4096 // unit of the time shift file
+	};
+
+	struct TimeEntry
+	{
+		qint64 position;
+		qint64 time; // ms; continuous across pcr wrap arounds and discontinuities
+	};
+
+	void addTimeEntry(qint64 position);
+	qint64 getMinimumPosition() const; // oldest position which can be read
+	bool isAvailable() const; // reader side; true if read() wouldn't block
+	void startAtLatestRandomAccessPoint(); // reader side
+	void skipToRandomAccessPoint(qint64 writePosition_);
+	int readTimeShift(char *data, int size); // -1 if the data isn't in the file
+	bool waitFor(int msecs); // returns false if time shift was stopped
+	void run();
+
+	char *ring;
+	QAtomicInteger<qint64> writePosition;
+	QAtomicInt generation; // incremented by reset()
+	QAtomicInt opened;
+	QAtomicInt interrupted;
+	QAtomicInt readerWaiting;
+
+	qint64 readPosition; // only accessed by the reader
+	int readGeneration;
+	qint64 droppedBytes;
+	QAtomicInteger<qint64> currentReadPosition; // for the main thread
+	QAtomicInteger<qint64> pendingSeekPosition; // -1 if there's no pending seek
+
+	QMutex randomAccessMutex; // protects the random access points and the time index
+	qint64 randomAccessPositions[RandomAccessCount];
+	int randomAccessIndex; // next slot
+	int randomAccessSize;
+	QList<TimeEntry> timeEntries;
+
+	QMutex waitMutex;
+	QWaitCondition dataAvailable;
+
+	// only accessed by the writer side
+	int videoPid; // -1 = any pid
+	int pcrPid;
+	qint64 lastPcr;
+	qint64 streamTime; // 90 kHz
+
+	bool timeShifting; // only accessed by the main thread
+	int timeShiftFileFd; // kept open across resets; only accessed by the main thread
+	qint64 timeShiftFileSize;
+	bool timeShiftAllocated; // accessed by the thread while it's running
+	QMutex timeShiftMutex; // protects timeShiftFd against the reader
+	int timeShiftFd;
+	qint64 timeShiftSize;
+	QAtomicInteger<qint64> timeShiftBegin; // first position of the file
+	QAtomicInteger<qint64> timeShiftEnd; // next position to be written to the file
+	QAtomicInt timeShiftStopped;
+	QMutex stopMutex;
+	QWaitCondition stopCondition;
+};
+
 class DvbLiveViewInternal : public QObject, public DvbPidFilter, public MediaSource
 {
 	Q_OBJECT
@@ -64,6 +184,47 @@ public:
 	~DvbLiveViewInternal();
 
 	void resetPipe();
+	void setVideoPid(int videoPid, int videoStreamType);
+	void setPreTunedData(const QByteArray &data); // inserted after the next pat / pmt
+	void insertPatPmt(const QByteArray &patPmt);
+
+	// monotonic timestamps (ms) since resetPipe(); -1 if there wasn't any
+	void getZapTimestamps(qint64 &firstPacket, qint64 &firstKeyFrame, qint64 &firstOutput);
+
+	bool isStreamOpen() const
+	{
+		return stream->isOpen();
+	}
+
+	bool startTimeShift(const QString &fileName, qint64 maximumSize)
+	{
+		QMutexLocker locker(&mutex);
+		return stream->startTimeShift(fileName, maximumSize);
+	}
+
+	void stopTimeShift()
+	{
+		QMutexLocker locker(&mutex);
+		stream->stopTimeShift();
+	}
+
+	void releaseTimeShiftFile()
+	{
+		QMutexLocker locker(&mutex);
+		stream->releaseTimeShiftFile();
+	}
+
+	void setFileTimeShift(bool fileTimeShift_)
+	{
+		QMutexLocker locker(&mutex);
+		fileTimeShift = fileTimeShift_;
+	}
+
+	// either the bounded time shift of the stream or the file (players without custom i/o)
+	bool isTimeShifting() const
+	{
+		return (timeShiftFile.isOpen() || stream->isTimeShifting());
+	}
 
 	MediaWidget *mediaWidget;
 	QString channelName;
@@ -71,6 +232,7 @@ public:
 	QByteArray pmtSectionData;
 	DvbSectionGenerator patGenerator;
 	DvbSectionGenerator pmtGenerator;
+	QMutex mutex; // protects buffer and the writer side of stream against the demux thread
 	QByteArray buffer;
 	QFile timeShiftFile;
 	QString fileName;
@@ -104,6 +266,15 @@ public:
 
 	QUrl getUrl() const { return url; }
 
+	QSharedPointer<MediaStream> getStream() const
+	{
+		// time shift uses the file
+		if (timeShiftFile.isOpen())
+			return QSharedPointer<MediaStream>();
+		else
+			return stream;
+	}
+
 	void updateUrl() {
 		if (timeShiftFile.isOpen())
 			url = QUrl::fromLocalFile(timeShiftFile.fileName());
@@ -112,9 +283,10 @@ public:
 	}
 
 	virtual void validateCurrentTotalTime(int &currentTime, int &totalTime) const;
-	bool hideCurrentTotalTime() const { return !timeshift; }
+	bool hideCurrentTotalTime() const { return !isTimeShifting(); }
+	bool overrideSeeking() const { return stream->isTimeShifting(); }
+	void seek(int time) { stream->seekTimeShift(time); }
 
-	bool timeshift;
 	QStringList audioStreams;
 	int currentAudioStream;
 	int currentSubtitle;
@@ -124,21 +296,44 @@ signals:
 	void currentAudioStreamChanged(int currentAudioStream);
 	void currentSubtitleChanged(int currentSubtitle);
 	void replay();
+	void videoOutputStarted();
 	void playbackFinished();
 	void playbackStatusChanged(MediaWidget::PlaybackStatus playbackStatus);
 	void previous();
 	void next();
 
 private slots:
+	void processBuffers();
 	void writeToPipe();
 
 private:
+	enum {
+		MaximumKeyFrameDelay = 2000, // ms; afterwards the data is passed on regardless
+		MaximumPendingBuffers = 256 // about 4 MiB; for the fifo and the time shift file
+	};
+
+	// called in the demux thread
 	void processData(const char data[188]);
+	void processPackets(const char *const *packets, int count);
+	bool checkKeyFrame(const char *packet);
+	void writeBuffer(const QByteArray &data); // mutex is held
+	qint64 currentTimestamp() const; // see zapTimer
 
 	QUrl url;
+	QSharedPointer<DvbLiveViewStream> stream;
 	int readFd;
 	int writeFd;
 	QSocketNotifier *notifier;
+	QList<QByteArray> pendingBuffers; // protected by mutex
+	int droppedBuffers; // protected by mutex
+	bool fileTimeShift; // protected by mutex
+	DvbKeyFrameDetector keyFrameDetector; // protected by mutex
+	bool waitingForKeyFrame; // protected by mutex
+	QByteArray preTunedData; // protected by mutex
+	QElapsedTimer zapTimer; // protected by mutex
+	qint64 firstPacketTimestamp; // protected by mutex
+	qint64 firstKeyFrameTimestamp; // protected by mutex
+	qint64 firstOutputTimestamp; // protected by mutex
 	QList<QByteArray> buffers;
 };
 
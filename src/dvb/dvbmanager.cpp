@@ -24,18 +24,21 @@
 #include <KConfigGroup>
 #include <KSharedConfig>
 #include <QDir>
+#include <QFileInfo>
 #include <QPluginLoader>
 #include <QRegularExpressionMatch>
 #include <QStandardPaths>
 
 #include "dvbconfig.h"
 #include "dvbdevice.h"
+#include "dvbdevice_file.h"
 #include "dvbdevice_linux.h"
 #include "dvbepg.h"
 #include "dvbliveview.h"
 #include "dvbmanager.h"
 #include "dvbmanager_p.h"
 #include "dvbsi.h"
+#include "dvbzapaccelerator.h"
 
 DvbManager::DvbManager(MediaWidget *mediaWidget_, QWidget *parent_) : QObject(parent_),
 	parent(parent_), mediaWidget(mediaWidget_), channelView(NULL), dvbDumpEnabled(false)
@@ -44,6 +47,7 @@ DvbManager::DvbManager(MediaWidget *mediaWidget_, QWidget *parent_) : QObject(pa
 	recordingModel = new DvbRecordingModel(this, this);
 	epgModel = new DvbEpgModel(this, this);
 	liveView = new DvbLiveView(this, this);
+	zapAccelerator = new DvbZapAccelerator(this);
 
 	readDeviceConfigs();
 	updateSourceMapping();
@@ -59,6 +63,8 @@ DvbManager::~DvbManager()
 
 	// we need an explicit deletion order (device users ; devices ; device manager)
 
+	delete zapAccelerator;
+	zapAccelerator = NULL;
 	delete epgModel;
 	epgModel = NULL;
 	delete recordingModel;
@@ -87,6 +93,8 @@ DvbDevice *DvbManager::requestDevice(const QString &source, const DvbTransponder
 
 			if (requestType == Prioritized) {
 				++deviceConfigs[i].prioritizedUseCount;
+			} else if (requestType == Standby) {
+				++deviceConfigs[i].standbyUseCount;
 			}
 
 			return it.device;
@@ -112,6 +120,8 @@ DvbDevice *DvbManager::requestDevice(const QString &source, const DvbTransponder
 
 				if (requestType == Prioritized) {
 					deviceConfigs[i].prioritizedUseCount = 1;
+				} else if (requestType == Standby) {
+					deviceConfigs[i].standbyUseCount = 1;
 				}
 
 				deviceConfigs[i].source = source;
@@ -122,6 +132,34 @@ DvbDevice *DvbManager::requestDevice(const QString &source, const DvbTransponder
 		}
 	}
 
+	if (requestType == Standby) {
+		return NULL;
+	}
+
+	// devices which are only pre-tuned are taken over (the users notice DeviceReleased)
+	for (int i = 0; i < deviceConfigs.size(); ++i) {
+		const DvbDeviceConfig &it = deviceConfigs.at(i);
+
+		if ((it.device == NULL) || (it.useCount <= 0) || (it.useCount != it.standbyUseCount)) {
+			continue;
+		}
+
+		foreach (const DvbConfig &config, it.configs) {
+			if (config->name == source) {
+				deviceConfigs[i].useCount = 1;
+				deviceConfigs[i].prioritizedUseCount = ((requestType == Prioritized) ? 1 : 0);
+				deviceConfigs[i].standbyUseCount = 0;
+				deviceConfigs[i].source = source;
+				deviceConfigs[i].transponder = transponder;
+
+				DvbDevice *device = it.device;
+				device->reacquire(config.constData());
+				device->tune(transponder);
+				return device;
+			}
+		}
+	}
+
 	if (requestType != Prioritized) {
 		return NULL;
 	}
@@ -137,6 +175,7 @@ DvbDevice *DvbManager::requestDevice(const QString &source, const DvbTransponder
 			if (config->name == source) {
 				deviceConfigs[i].useCount = 1;
 				deviceConfigs[i].prioritizedUseCount = 1;
+				deviceConfigs[i].standbyUseCount = 0;
 				deviceConfigs[i].source = source;
 				deviceConfigs[i].transponder = transponder;
 
@@ -176,6 +215,28 @@ DvbDevice *DvbManager::requestExclusiveDevice(const QString &source)
 		}
 	}
 
+	// devices which are only pre-tuned are taken over (the users notice DeviceReleased)
+	for (int i = 0; i < deviceConfigs.size(); ++i) {
+		const DvbDeviceConfig &it = deviceConfigs.at(i);
+
+		if ((it.device == NULL) || (it.useCount <= 0) || (it.useCount != it.standbyUseCount)) {
+			continue;
+		}
+
+		foreach (const DvbConfig &config, it.configs) {
+			if (config->name == source) {
+				deviceConfigs[i].useCount = -1;
+				deviceConfigs[i].prioritizedUseCount = 0;
+				deviceConfigs[i].standbyUseCount = 0;
+				deviceConfigs[i].source.clear();
+
+				DvbDevice *device = it.device;
+				device->reacquire(config.constData());
+				return device;
+			}
+		}
+	}
+
 	return NULL;
 }
 
@@ -186,14 +247,20 @@ void DvbManager::releaseDevice(DvbDevice *device, RequestType requestType)
 
 		if (it.device == device) {
 			switch (requestType) {
-			case Prioritized:
-				--deviceConfigs[i].prioritizedUseCount;
-				Q_ASSERT(it.prioritizedUseCount >= 0);
-			// fall through
 			case Shared:
+			case Prioritized:
+			case Standby:
+				if (requestType == Prioritized) {
+					--deviceConfigs[i].prioritizedUseCount;
+					Q_ASSERT(it.prioritizedUseCount >= 0);
+				} else if (requestType == Standby) {
+					--deviceConfigs[i].standbyUseCount;
+					Q_ASSERT(it.standbyUseCount >= 0);
+				}
+
 				--deviceConfigs[i].useCount;
 				Q_ASSERT(it.useCount >= 0);
-				Q_ASSERT(it.useCount >= it.prioritizedUseCount);
+				Q_ASSERT(it.useCount >= (it.prioritizedUseCount + it.standbyUseCount));
 
 				if (it.useCount == 0) {
 					it.device->release();
@@ -309,6 +376,108 @@ QList<DvbTransponder> DvbManager::getTransponders(DvbDevice *device, const QStri
 	return scanData.value(scanSource);
 }
 
+// appends one transponder per parameter set; the most common parameter sets come first
+static void appendParameterSets(QList<DvbTransponder> &hints,
+	const QList<DvbTransponder> &transponders)
+{
+	QMap<QString, int> counts;
+	QMap<QString, DvbTransponder> parameterSets;
+
+	foreach (const DvbTransponder &transponder, transponders) {
+		const DvbTTransponder *dvbTTransponder = transponder.as<DvbTTransponder>();
+
+		if (dvbTTransponder == NULL) {
+			continue;
+		}
+
+		QString key = QString(QLatin1String("%1 %2 %3 %4")).arg(dvbTTransponder->fecRateHigh).
+			arg(dvbTTransponder->guardInterval).arg(dvbTTransponder->modulation).
+			arg(dvbTTransponder->transmissionMode);
+		++counts[key];
+		parameterSets.insert(key, transponder);
+	}
+
+	QList<QPair<int, QString> > order;
+
+	for (QMap<QString, int>::ConstIterator it = counts.constBegin(); it != counts.constEnd();
+	     ++it) {
+		order.append(qMakePair(-it.value(), it.key()));
+	}
+
+	qSort(order);
+
+	for (int i = 0; i < order.size(); ++i) {
+		hints.append(parameterSets.value(order.at(i).second));
+	}
+}
+
+QList<DvbTransponder> DvbManager::getAutoTuneHints(int frequency)
+{
+	if (scanData.isEmpty()) {
+		readScanData();
+	}
+
+	QList<DvbTransponder> hints;
+	QList<DvbTransponder> previousResults;
+
+	foreach (const QString &entry,
+		 KSharedConfig::openConfig()->group("DVB").readEntry("AutoTuneCache", QStringList())) {
+		DvbTransponder transponder = DvbTransponder::fromString(entry);
+
+		if (transponder.getTransmissionType() != DvbTransponderBase::DvbT) {
+			continue;
+		}
+
+		if (transponder.frequency() == frequency) {
+			hints.append(transponder);
+		} else {
+			// other frequencies in the same region are likely to use the same parameters
+			previousResults.append(transponder);
+		}
+	}
+
+	appendParameterSets(hints, previousResults);
+	QList<DvbTransponder> scanFileTransponders;
+
+	for (QMap<QPair<TransmissionType, QString>, QList<DvbTransponder> >::ConstIterator it =
+	     scanData.constBegin(); it != scanData.constEnd(); ++it) {
+		if ((it.key().first == DvbT) || (it.key().first == DvbT2)) {
+			scanFileTransponders.append(*it);
+		}
+	}
+
+	appendParameterSets(hints, scanFileTransponders);
+	return hints;
+}
+
+void DvbManager::addAutoTuneResult(const DvbTransponder &transponder)
+{
+	DvbTransponder result = transponder;
+
+	if (result.getTransmissionType() != DvbTransponderBase::DvbT) {
+		return;
+	}
+
+	KConfigGroup group = KSharedConfig::openConfig()->group("DVB");
+	QStringList cache = group.readEntry("AutoTuneCache", QStringList());
+	int frequency = result.frequency();
+
+	for (int i = 0; i < cache.size(); ++i) {
+		if (DvbTransponder::fromString(cache.at(i)).frequency() == frequency) {
+			cache.removeAt(i);
+			--i;
+		}
+	}
+
+	cache.append(result.toString());
+
+	while (cache.size() > 256) {
+		cache.removeFirst();
+	}
+
+	group.writeEntry("AutoTuneCache", cache);
+}
+
 bool DvbManager::updateScanData(const QByteArray &data)
 {
 	QByteArray uncompressed = qUncompress(data);
@@ -347,6 +516,21 @@ QString DvbManager::getTimeShiftFolder() const
 	return KSharedConfig::openConfig()->group("DVB").readEntry("TimeShiftFolder", QDir::homePath());
 }
 
+int DvbManager::getTimeShiftSize() const
+{
+	return KSharedConfig::openConfig()->group("DVB").readEntry("TimeShiftSize", 2048);
+}
+
+bool DvbManager::isAlwaysOnTimeShift() const
+{
+	return KSharedConfig::openConfig()->group("DVB").readEntry("AlwaysOnTimeShift", false);
+}
+
+bool DvbManager::isZapAccelerationEnabled() const
+{
+	return KSharedConfig::openConfig()->group("DVB").readEntry("ZapAcceleration", false);
+}
+
 int DvbManager::getBeginMargin() const
 {
 	return KSharedConfig::openConfig()->group("DVB").readEntry("BeginMargin", 300);
@@ -357,6 +541,16 @@ int DvbManager::getEndMargin() const
 	return KSharedConfig::openConfig()->group("DVB").readEntry("EndMargin", 600);
 }
 
+int DvbManager::getDvrBufferSize() const
+{
+	return KSharedConfig::openConfig()->group("DVB").readEntry("DvrBufferSize", 4);
+}
+
+int DvbManager::getFullTsThreshold() const
+{
+	return KSharedConfig::openConfig()->group("DVB").readEntry("FullTsThreshold", 16);
+}
+
 QString DvbManager::getNamingFormat() const
 {
 	return KSharedConfig::openConfig()->group("DVB").readEntry("NamingFormat", "%title");
@@ -392,11 +586,26 @@ bool DvbManager::isScanWhenIdle() const
 	return KSharedConfig::openConfig()->group("DVB").readEntry("ScanWhenIdle", false);
 }
 
+bool DvbManager::useKernelSectionFilters() const
+{
+	return KSharedConfig::openConfig()->group("DVB").readEntry("KernelSectionFilters", false);
+}
+
 bool DvbManager::createInfoFile() const
 {
 	return KSharedConfig::openConfig()->group("DVB").readEntry("CreateInfoFile", false);
 }
 
+bool DvbManager::useDirectRecordingIo() const
+{
+	return KSharedConfig::openConfig()->group("DVB").readEntry("DirectRecordingIo", false);
+}
+
+bool DvbManager::recordEntireTransponder() const
+{
+	return KSharedConfig::openConfig()->group("DVB").readEntry("RecordEntireTransponder", false);
+}
+
 void DvbManager::setRecordingFolder(const QString &path)
 {
 	KSharedConfig::openConfig()->group("DVB").writeEntry("RecordingFolder", path);
@@ -407,6 +616,25 @@ void DvbManager::setTimeShiftFolder(const QString &path)
 	KSharedConfig::openConfig()->group("DVB").writeEntry("TimeShiftFolder", path);
 }
 
+void DvbManager::setTimeShiftSize(int timeShiftSize)
+{
+	KSharedConfig::openConfig()->group("DVB").writeEntry("TimeShiftSize", timeShiftSize);
+}
+
+void DvbManager::setAlwaysOnTimeShift(bool alwaysOnTimeShift)
+{
+	KSharedConfig::openConfig()->group("DVB").writeEntry("AlwaysOnTimeShift", alwaysOnTimeShift);
+}
+
+void DvbManager::setZapAccelerationEnabled(bool zapAccelerationEnabled)
+{
+	KSharedConfig::openConfig()->group("DVB").writeEntry("ZapAcceleration", zapAccelerationEnabled);
+
+	if (!zapAccelerationEnabled) {
+		zapAccelerator->releaseDevices();
+	}
+}
+
 void DvbManager::setBeginMargin(int beginMargin)
 {
 	KSharedConfig::openConfig()->group("DVB").writeEntry("BeginMargin", beginMargin);
@@ -417,6 +645,28 @@ void DvbManager::setEndMargin(int endMargin)
 	KSharedConfig::openConfig()->group("DVB").writeEntry("EndMargin", endMargin);
 }
 
+void DvbManager::setDvrBufferSize(int dvrBufferSize)
+{
+	KSharedConfig::openConfig()->group("DVB").writeEntry("DvrBufferSize", dvrBufferSize);
+
+	foreach (const DvbDeviceConfig &deviceConfig, deviceConfigs) {
+		if (deviceConfig.device != NULL) {
+			deviceConfig.device->setDataBufferSize(dvrBufferSize * 1024 * 1024);
+		}
+	}
+}
+
+void DvbManager::setFullTsThreshold(int fullTsThreshold)
+{
+	KSharedConfig::openConfig()->group("DVB").writeEntry("FullTsThreshold", fullTsThreshold);
+
+	foreach (const DvbDeviceConfig &deviceConfig, deviceConfigs) {
+		if (deviceConfig.device != NULL) {
+			deviceConfig.device->setFullTsThreshold(fullTsThreshold);
+		}
+	}
+}
+
 void DvbManager::setNamingFormat(QString namingFormat)
 {
 	KSharedConfig::openConfig()->group("DVB").writeEntry("NamingFormat", namingFormat);
@@ -493,11 +743,33 @@ void DvbManager::setScanWhenIdle(bool scanWhenIdle)
 	KSharedConfig::openConfig()->group("DVB").writeEntry("ScanWhenIdle", scanWhenIdle);
 }
 
+void DvbManager::setKernelSectionFilters(bool kernelSectionFilters)
+{
+	KSharedConfig::openConfig()->group("DVB").writeEntry("KernelSectionFilters", kernelSectionFilters);
+
+	foreach (const DvbDeviceConfig &deviceConfig, deviceConfigs) {
+		if (deviceConfig.device != NULL) {
+			deviceConfig.device->setKernelSectionFilters(kernelSectionFilters);
+		}
+	}
+}
+
 void DvbManager::setCreateInfoFile(bool createInfoFile)
 {
 	KSharedConfig::openConfig()->group("DVB").writeEntry("CreateInfoFile", createInfoFile);
 }
 
+void DvbManager::setDirectRecordingIo(bool directRecordingIo)
+{
+	KSharedConfig::openConfig()->group("DVB").writeEntry("DirectRecordingIo", directRecordingIo);
+}
+
+void DvbManager::setRecordEntireTransponder(bool recordEntireTransponder)
+{
+	KSharedConfig::openConfig()->group("DVB").writeEntry("RecordEntireTransponder",
+		recordEntireTransponder);
+}
+
 void DvbManager::enableDvbDump()
 {
 	if (dvbDumpEnabled) {
@@ -513,6 +785,21 @@ void DvbManager::enableDvbDump()
 	}
 }
 
+void DvbManager::addReplayDevice(const QString &path, bool paced)
+{
+	QString absolutePath = QFileInfo(path).absoluteFilePath();
+
+	foreach (const DvbDeviceConfig &deviceConfig, deviceConfigs) {
+		if ((deviceConfig.device != NULL) &&
+		    (deviceConfig.device->getDeviceId() == (QLatin1String("F:") + absolutePath))) {
+			return;
+		}
+	}
+
+	qCInfo(logDvb, "Adding replay device for %s", qPrintable(absolutePath));
+	deviceAdded(new DvbFileDevice(absolutePath, paced, this));
+}
+
 void DvbManager::requestBuiltinDeviceManager(QObject *&builtinDeviceManager)
 {
 	builtinDeviceManager = new DvbLinuxDeviceManager(this);
@@ -524,6 +811,10 @@ void DvbManager::deviceAdded(DvbBackendDevice *backendDevice)
 	QString deviceId = device->getDeviceId();
 	QString frontendName = device->getFrontendName();
 
+	device->setDataBufferSize(getDvrBufferSize() * 1024 * 1024);
+	device->setKernelSectionFilters(useKernelSectionFilters());
+	device->setFullTsThreshold(getFullTsThreshold());
+
 	if (dvbDumpEnabled) {
 		device->enableDvbDump();
 	}
@@ -553,6 +844,7 @@ void DvbManager::deviceRemoved(DvbBackendDevice *backendDevice)
 			if (it.useCount != 0) {
 				it.useCount = 0;
 				it.prioritizedUseCount = 0;
+				it.standbyUseCount = 0;
 				it.device->release();
 			}
 
@@ -945,7 +1237,7 @@ void DvbManager::readScanData()
 
 DvbDeviceConfig::DvbDeviceConfig(const QString &deviceId_, const QString &frontendName_,
 	DvbDevice *device_) : deviceId(deviceId_), frontendName(frontendName_), device(device_),
-	useCount(0), prioritizedUseCount(0)
+	useCount(0), prioritizedUseCount(0), standbyUseCount(0)
 {
 }
 
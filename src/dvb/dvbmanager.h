@@ -39,6 +39,7 @@ class DvbEpgModel;
 class DvbLiveView;
 class DvbRecordingModel;
 class DvbScanData;
+class DvbZapAccelerator;
 class MediaWidget;
 
 class DvbManager : public QObject
@@ -48,7 +49,8 @@ public:
 	enum RequestType {
 		Shared,
 		Exclusive, // you can freely tune() and stop(), because the device isn't shared
-		Prioritized // takes precedence over 'Shared' and 'Exclusive'
+		Prioritized, // takes precedence over 'Shared' and 'Exclusive'
+		Standby // only idle devices; yields to all other requests (see DvbZapAccelerator)
 	};
 
 	enum TransmissionType {
@@ -104,6 +106,11 @@ public:
 		return recordingModel;
 	}
 
+	DvbZapAccelerator *getZapAccelerator() const
+	{
+		return zapAccelerator;
+	}
+
 	void setChannelView(QTreeView *channelView_)
 	{
 		channelView = channelView_;
@@ -121,12 +128,18 @@ public:
 	QStringList getScanSources(TransmissionType type);
 	QString getAutoScanSource(const QString &source) const;
 	QList<DvbTransponder> getTransponders(DvbDevice *device, const QString &source);
+	// likely dvb-t parameters (previous auto-tune results, then the scan file); most likely first
+	QList<DvbTransponder> getAutoTuneHints(int frequency);
+	void addAutoTuneResult(const DvbTransponder &transponder);
 	QHash<QString, bool> languageCodes;
 	QString currentEpgLanguage;
 	bool updateScanData(const QByteArray &data);
 
 	QString getRecordingFolder() const;
 	QString getTimeShiftFolder() const;
+	int getTimeShiftSize() const; // MiB
+	bool isAlwaysOnTimeShift() const;
+	bool isZapAccelerationEnabled() const;
 	QString getNamingFormat() const;
 	QString getRecordingRegex() const;
 	QStringList getRecordingRegexList() const;
@@ -134,11 +147,19 @@ public:
 	QString getActionAfterRecording() const;
 	int getBeginMargin() const; // seconds
 	int getEndMargin() const; // seconds
+	int getDvrBufferSize() const; // MiB
+	int getFullTsThreshold() const; // number of pids; 0 means never
 	bool override6937Charset() const;
 	bool createInfoFile() const;
+	bool recordEntireTransponder() const;
 	bool isScanWhenIdle() const;
+	bool useKernelSectionFilters() const;
+	bool useDirectRecordingIo() const;
 	void setRecordingFolder(const QString &path);
 	void setTimeShiftFolder(const QString &path);
+	void setTimeShiftSize(int timeShiftSize); // MiB
+	void setAlwaysOnTimeShift(bool alwaysOnTimeShift);
+	void setZapAccelerationEnabled(bool zapAccelerationEnabled);
 	void setNamingFormat(const QString namingFormat);
 	void setRecordingRegex(const QString regex);
 	void setRecordingRegexList(const QStringList regexList);
@@ -150,12 +171,18 @@ public:
 	void setActionAfterRecording(const QString actionAfterRecording);
 	void setBeginMargin(int beginMargin); // seconds
 	void setEndMargin(int endMargin); // seconds
+	void setDvrBufferSize(int dvrBufferSize); // MiB
+	void setFullTsThreshold(int fullTsThreshold); // number of pids; 0 means never
 	void setOverride6937Charset(bool override);
 	void setCreateInfoFile(bool createInfoFile);
+	void setRecordEntireTransponder(bool recordEntireTransponder);
 	void setScanWhenIdle(bool scanWhenIdle);
+	void setKernelSectionFilters(bool kernelSectionFilters);
+	void setDirectRecordingIo(bool directRecordingIo);
 	void writeDeviceConfigs();
 
 	void enableDvbDump();
+	void addReplayDevice(const QString &path, bool paced);
 	bool hasReacquired() { return reacquireDevice; };
 
 private slots:
@@ -179,6 +206,7 @@ private:
 	DvbEpgModel *epgModel;
 	DvbLiveView *liveView;
 	DvbRecordingModel *recordingModel;
+	DvbZapAccelerator *zapAccelerator;
 	bool reacquireDevice;
 
 	QList<DvbDeviceConfig> deviceConfigs;
@@ -204,6 +232,7 @@ public:
 	QList<DvbConfig> configs;
 	int useCount; // -1 means exclusive use
 	int prioritizedUseCount;
+	int standbyUseCount;
 	int numberOfTuners;
 	QString source;
 	DvbTransponder transponder;
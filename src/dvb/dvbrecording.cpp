@@ -21,18 +21,24 @@
 #include "../log.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <QCoreApplication>
 #include <QDataStream>
 #include <QDir>
 #include <QEventLoop>
+#include <QFile>
 #include <QMap>
 #include <QProcess>
 #include <QSet>
 #include <QStandardPaths>
 #include <QVariant>
+#include <QtEndian>
 
 #include "../ensurenopendingoperation.h"
+#include "dvbconfig.h"
 #include "dvbdevice.h"
 #include "dvbepg.h"
 #include "dvbliveview.h"
@@ -58,17 +64,21 @@ bool DvbRecording::validate()
 }
 
 DvbRecordingModel::DvbRecordingModel(DvbManager *manager_, QObject *parent) : QObject(parent),
-	manager(manager_), hasPendingOperation(false)
+	manager(manager_), hasPendingOperation(false), conflictCheckPending(false),
+	autoRecordingRulesValid(false), similarRecordingLength(0), similarRecordingsValid(false)
 {
+	// the timer wakes up at the next start / stop of a recording (see recordingTimeout())
+	recordingTimer.setSingleShot(true);
+	recordingTimer.setTimerType(Qt::PreciseTimer);
+	connect(&recordingTimer, SIGNAL(timeout()), this, SLOT(recordingTimeout()));
+
 	sqlInit(QLatin1String("RecordingSchedule"),
 		QStringList() << QLatin1String("Name") << QLatin1String("Channel") << QLatin1String("Begin") <<
 		QLatin1String("Duration") << QLatin1String("Repeat") << QLatin1String("Subheading") << QLatin1String("Details")
 		<< QLatin1String("beginEPG") << QLatin1String("endEPG") << QLatin1String("durationEPG") << QLatin1String("Priority") << QLatin1String("Disabled"));
 
-	// we regularly recheck the status of the recordings
-	// this way we can keep retrying if the device was busy / tuning failed
-
-	startTimer(5000);
+	// the devices are known once the event loop runs
+	scheduleConflictCheck();
 
 	// compatibility code
 
@@ -198,7 +208,15 @@ DvbSharedRecording DvbRecordingModel::addRecording(DvbRecording &recording, bool
 	DvbSharedRecording newRecording(new DvbRecording(recording));
 	recordings.insert(*newRecording, newRecording);
 	sqlInsert(*newRecording);
+
+	if (similarRecordingsValid) {
+		insertSimilarRecording(*newRecording);
+	}
+
+	scheduleRecordingEvent(*newRecording);
+
 	emit recordingAdded(newRecording);
+	scheduleConflictCheck();
 	return newRecording;
 }
 
@@ -219,10 +237,13 @@ void DvbRecordingModel::updateRecording(DvbSharedRecording recording,
 	}
 
 	modifiedRecording.setSqlKey(*recording);
+	similarRecordingsValid = false;
 
 	if (!updateStatus(modifiedRecording)) {
 		recordings.remove(*recording);
 		recordingFiles.remove(*recording);
+		unscheduleRecordingEvent(*recording);
+		updateRecordingTimer();
 		sqlRemove(*recording);
 		emit recordingRemoved(recording);
 		return;
@@ -230,8 +251,10 @@ void DvbRecordingModel::updateRecording(DvbSharedRecording recording,
 
 	emit recordingAboutToBeUpdated(recording);
 	*const_cast<DvbRecording *>(recording.constData()) = modifiedRecording;
+	scheduleRecordingEvent(*recording);
 	sqlUpdate(*recording);
 	emit recordingUpdated(recording);
+	scheduleConflictCheck();
 }
 
 void DvbRecordingModel::removeRecording(DvbSharedRecording recording)
@@ -250,10 +273,12 @@ void DvbRecordingModel::removeRecording(DvbSharedRecording recording)
 
 	recordings.remove(*recording);
 	recordingFiles.remove(*recording);
+	unscheduleRecordingEvent(*recording);
+	updateRecordingTimer();
 	sqlRemove(*recording);
+	similarRecordingsValid = false;
 	emit recordingRemoved(recording);
 	executeActionAfterRecording(*recording);
-	findNewRecordings();
 	removeDuplicates();
 	disableConflicts();
 }
@@ -276,6 +301,7 @@ void DvbRecordingModel::disableLessImportant(DvbSharedRecording &recording1, Dvb
 void DvbRecordingModel::addToUnwantedRecordings(DvbSharedRecording recording)
 {
 	unwantedRecordings.append(recording);
+	similarRecordingsValid = false;
 	qCDebug(logDvb, "executed %s", qPrintable(recording->name));
 }
 
@@ -295,6 +321,29 @@ void DvbRecordingModel::executeActionAfterRecording(DvbRecording recording)
 
 }
 
+void DvbRecordingModel::executeActionAfterWriting(DvbRecording recording, QThread *writer)
+{
+	pendingActions.insert(writer, recording);
+	connect(writer, SIGNAL(finished()), this, SLOT(writerFinished()),
+		Qt::ConnectionType(Qt::QueuedConnection | Qt::UniqueConnection));
+
+	if (!writer->isRunning()) {
+		// finished in the meantime (a queued writerFinished() is ignored)
+		pendingActions.remove(writer);
+		executeActionAfterRecording(recording);
+	}
+}
+
+void DvbRecordingModel::writerFinished()
+{
+	QObject *writer = sender();
+	disconnect(writer, SIGNAL(finished()), this, SLOT(writerFinished()));
+
+	if (pendingActions.contains(writer)) {
+		executeActionAfterRecording(pendingActions.take(writer));
+	}
+}
+
 void DvbRecordingModel::removeDuplicates()
 {
 	QList<DvbSharedRecording> recordingList = QList<DvbSharedRecording>();
@@ -322,6 +371,7 @@ void DvbRecordingModel::removeDuplicates()
 					&& loopEntry1.channel->name == loopEntry2.channel->name
 					&& loopEntry1.name == loopEntry2.name) {
 					recordings.remove(recordings.key(rec1));
+					unscheduleRecordingEvent(*rec1);
 					recordingMap.remove(rec1);
 					qCDebug(logDvb, "Removed. %s", qPrintable(loopEntry1.name));
 				}
@@ -331,178 +381,332 @@ void DvbRecordingModel::removeDuplicates()
 		i = i + 1;
 	}
 	epgModel->setRecordings(recordingMap);
+	similarRecordingsValid = false;
 
 	qCDebug(logDvb, "executed.");
 
 }
 
-bool DvbRecordingModel::existsSimilarRecording(DvbEpgEntry recording)
+static QString unwantedRecordingKey(const QString &channelName, const QDateTime &begin,
+	int duration)
 {
-	bool found = false;
+	return channelName + QLatin1Char('|') + QString::number(begin.toMSecsSinceEpoch()) +
+		QLatin1Char('|') + QString::number(duration);
+}
 
-	DvbEpgEntry entry = recording;
-	DvbEpgModel *epgModel = manager->getEpgModel();
+void DvbRecordingModel::insertSimilarRecording(const DvbRecording &recording)
+{
+	// only recordings which were scheduled from the epg have an epg span
+	if (!recording.beginEPG.isValid() || !recording.channel.isValid()) {
+		return;
+	}
 
-	if (!epgModel)
-		return found;
+	int length = QTime(0, 0, 0).secsTo(recording.durationEPG);
+	similarRecordings[recording.channel->name].insert(recording.beginEPG,
+		recording.beginEPG.addSecs(length));
+	similarRecordingLength = qMax(similarRecordingLength, qint64(length));
+}
 
-	QMap<DvbSharedRecording, DvbSharedEpgEntry> recordingMap = epgModel->getRecordings();
-	foreach(DvbSharedRecording key, recordingMap.keys())
-	{
-		DvbEpgEntry loopEntry = *(recordingMap.value(key));
-		int loopLength = 60 * 60 * loopEntry.duration.hour() + 60 * loopEntry.duration.minute() + loopEntry.duration.second();
-		int length = 60 * 60 * entry.duration.hour() + 60 * entry.duration.minute() + entry.duration.second();
-		QDateTime end = entry.begin.addSecs(length);
-		QDateTime loopEnd = loopEntry.begin.addSecs(loopLength);
-
-		if (QString::compare(entry.channel->name, loopEntry.channel->name) == 0) {
-			// Is included in an existing recording
-			if (entry.begin <= loopEntry.begin && end >= loopEnd) {
-				found = true;
-				break;
-			// Includes an existing recording
-			} else if (entry.begin >= loopEntry.begin && end <= loopEnd) {
-				found = true;
-				break;
+void DvbRecordingModel::updateSimilarRecordings()
+{
+	similarRecordings.clear();
+	similarRecordingLength = 0;
+	unwantedRecordingKeys.clear();
+
+	foreach (const DvbSharedRecording &recording, recordings) {
+		insertSimilarRecording(*recording);
+	}
+
+	// unwanted recordings include the margins
+	int beginMargin = manager->getBeginMargin();
+	int endMargin = manager->getEndMargin();
+
+	foreach (const DvbSharedRecording &unwanted, unwantedRecordings) {
+		unwantedRecordingKeys.insert(unwantedRecordingKey(unwanted->channel->name,
+			unwanted->begin.addSecs(beginMargin),
+			QTime(0, 0, 0).secsTo(unwanted->duration) - beginMargin - endMargin));
+	}
+
+	similarRecordingsValid = true;
+}
+
+bool DvbRecordingModel::existsSimilarRecording(const DvbEpgEntry &entry)
+{
+	if (!similarRecordingsValid) {
+		updateSimilarRecordings();
+	}
+
+	int length = QTime(0, 0, 0).secsTo(entry.duration);
+	QDateTime end = entry.begin.addSecs(length);
+	QHash<QString, QMultiMap<QDateTime, QDateTime> >::ConstIterator channelIt =
+		similarRecordings.constFind(entry.channel->name);
+
+	if (channelIt != similarRecordings.constEnd()) {
+		// spans beginning before this point can't include the entry
+		QMultiMap<QDateTime, QDateTime>::ConstIterator it =
+			channelIt->lowerBound(entry.begin.addSecs(-similarRecordingLength));
+
+		for (; (it != channelIt->constEnd()) && (it.key() <= end); ++it) {
+			// includes an existing recording or is included in an existing recording
+			if (((entry.begin <= it.key()) && (end >= it.value())) ||
+			    ((entry.begin >= it.key()) && (end <= it.value()))) {
+				return true;
 			}
 		}
 	}
 
-	QList<DvbSharedRecording> unwantedRecordingsList = manager->getRecordingModel()->getUnwantedRecordings();
+	if (unwantedRecordingKeys.contains(unwantedRecordingKey(entry.channel->name, entry.begin,
+	    length))) {
+		qCDebug(logDvb, "Found from unwanteds %s", qPrintable(entry.title(FIRST_LANG)));
+		return true;
+	}
+
+	return false;
+}
 
-	foreach(DvbSharedRecording unwanted, unwantedRecordingsList)
-	{
-		DvbRecording loopEntry = *unwanted;
-		if (QString::compare(entry.begin.toString(), ((loopEntry.begin.addSecs(manager->getBeginMargin()))).toString()) == 0
-				&& QString::compare(entry.channel->name, loopEntry.channel->name) == 0
-				&& QString::compare((entry.duration).toString(),
-						loopEntry.duration.addSecs(- manager->getBeginMargin() - manager->getEndMargin()).toString()) == 0) {
-			qCDebug(logDvb, "Found from unwanteds %s", qPrintable(loopEntry.name));
-			found = true;
+void DvbRecordingScheduler::addTuner(const QString &name, const QStringList &sources)
+{
+	Tuner tuner;
+	tuner.name = name;
+	tuner.sources = sources;
+	tuners.append(tuner);
+}
+
+bool DvbRecordingScheduler::fits(const Tuner &tuner, const DvbSharedRecording &recording,
+	bool &shared) const
+{
+	shared = false;
+
+	if (!tuner.sources.contains(recording->channel->source)) {
+		return false;
+	}
+
+	// intervals beginning before this point can't overlap
+	QMultiMap<QDateTime, Interval>::ConstIterator it =
+		tuner.intervals.lowerBound(recording->begin.addSecs(-tuner.maximumLength));
+	QMultiMap<QDateTime, Interval>::ConstIterator end = tuner.intervals.constEnd();
+
+	for (; (it != end) && (it.key() < recording->end); ++it) {
+		if (it->end <= recording->begin) {
+			continue;
+		}
+
+		if ((it->source != recording->channel->source) ||
+		    !it->transponder.corresponds(recording->channel->transponder)) {
+			return false;
+		}
+
+		shared = true;
+	}
+
+	return true;
+}
+
+int DvbRecordingScheduler::schedule(const DvbSharedRecording &recording)
+{
+	int bestIndex = -1;
+
+	for (int i = 0; i < tuners.size(); ++i) {
+		bool shared;
+
+		if (!fits(tuners.at(i), recording, shared)) {
+			continue;
+		}
+
+		if (shared) {
+			// doesn't occupy anything new
+			bestIndex = i;
 			break;
 		}
+
+		// keep the tuners which can receive more sources free
+		if ((bestIndex < 0) ||
+		    (tuners.at(i).sources.size() < tuners.at(bestIndex).sources.size())) {
+			bestIndex = i;
+		}
 	}
 
-	return found;
+	if (bestIndex >= 0) {
+		Tuner &tuner = tuners[bestIndex];
+		Interval interval;
+		interval.end = recording->end;
+		interval.source = recording->channel->source;
+		interval.transponder = recording->channel->transponder;
+		tuner.intervals.insert(recording->begin, interval);
+		tuner.maximumLength =
+			qMax(tuner.maximumLength, qint64(recording->begin.secsTo(recording->end)));
+	}
+
+	return bestIndex;
+}
+
+static bool recordingHasPrecedence(const DvbSharedRecording &recording1,
+	const DvbSharedRecording &recording2)
+{
+	// running recordings already occupy their tuner
+	bool running1 = (recording1->status == DvbRecording::Recording);
+	bool running2 = (recording2->status == DvbRecording::Recording);
+
+	if (running1 != running2) {
+		return running1;
+	}
+
+	if (recording1->priority != recording2->priority) {
+		return (recording1->priority > recording2->priority);
+	}
+
+	if (recording1->begin != recording2->begin) {
+		return (recording1->begin < recording2->begin);
+	}
+
+	return (*recording1 < *recording2);
 }
 
 void DvbRecordingModel::disableConflicts()
 {
-	int maxSize = 1; // manager->getDeviceConfigs().size();
-	// foreach(DvbDeviceConfig config, manager->getDeviceConfigs())
-	// {
-	//	maxSize = maxSize + config.numberOfTuners;
-	// }
+	conflictCheckPending = false;
+	DvbRecordingScheduler scheduler;
 
-	QList<DvbSharedRecording> recordingList = QList<DvbSharedRecording>();
-	foreach(DvbSharedRecording rec, recordings.values())
-	{
-		if (!(rec->disabled)) {
-			recordingList.append(rec);
+	// every device config is one tuner; devices which are unplugged at the moment count
+	foreach (const DvbDeviceConfig &deviceConfig, manager->getDeviceConfigs()) {
+		QStringList sources;
+
+		foreach (const DvbConfig &config, deviceConfig.configs) {
+			sources.append(config->name);
+		}
+
+		if (!sources.isEmpty()) {
+			scheduler.addTuner(deviceConfig.frontendName, sources);
 		}
 	}
 
-	foreach(DvbSharedRecording rec1, recordingList)
-	{
-		QList<DvbSharedRecording> conflictList = QList<DvbSharedRecording>();
-		conflictList.append(rec1);
+	plannedTuners.clear();
 
-		foreach(DvbSharedRecording rec2, recordingList)
-		{
-			if (isInConflictWithAll(rec2, conflictList)) {
-				conflictList.append(rec2);
-				qCDebug(logDvb, "conflict: '%s' '%s' and '%s' '%s'", qPrintable(rec1->name), qPrintable(rec1->begin.toString()), qPrintable(rec2->name), qPrintable(rec2->begin.toString()));
+	if (!scheduler.hasTuners()) {
+		// nothing is configured yet; don't disable everything
+		emit plannedTunersChanged();
+		return;
+	}
 
-			}
+	QDateTime currentDateTime = QDateTime::currentDateTime().toUTC();
+	QList<DvbSharedRecording> recordingList;
 
-		}
-		if (conflictList.size() > maxSize) {
-			disableLeastImportants(conflictList);
+	foreach (const DvbSharedRecording &recording, recordings) {
+		if (!recording->disabled && recording->channel.isValid() &&
+		    (recording->end > currentDateTime)) {
+			recordingList.append(recording);
 		}
 	}
 
-}
+	qSort(recordingList.begin(), recordingList.end(), recordingHasPrecedence);
+	// recordings which don't fit anymore are skipped; they are reconsidered on every check
+	QSet<SqlKey> previousConflicts = conflictingRecordings;
+	conflictingRecordings.clear();
 
+	foreach (const DvbSharedRecording &recording, recordingList) {
+		int index = scheduler.schedule(recording);
 
-bool DvbRecordingModel::areInConflict(DvbSharedRecording recording1, DvbSharedRecording recording2)
-{
-	int length1 = 60 * 60 * recording1->duration.hour() + 60 * recording1->duration.minute() + recording1->duration.second();
-	QDateTime end1 = recording1->begin.addSecs(length1);
-	int length2 = 60 * 60 * recording2->duration.hour() + 60 * recording2->duration.minute() + recording2->duration.second();
-	QDateTime end2 = recording2->begin.addSecs(length2);
-	if (!recording1->disabled && !recording1->disabled) {
-		if (recording1->channel->transportStreamId != recording2->channel->transportStreamId) {
-			if (recording2->begin > recording1->begin && recording2->begin < end1) {
-				return true;
-			}
-			if (recording1->begin > recording2->begin && recording1->begin < end2) {
-				return true;
+		if (index >= 0) {
+			plannedTuners.insert(*recording, scheduler.getTunerName(index));
+		} else {
+			conflictingRecordings.insert(*recording);
+
+			if (!previousConflicts.contains(*recording)) {
+				qCInfo(logDvb, "Skipping %s at %s because no tuner is available",
+					qPrintable(recording->name), qPrintable(recording->begin.toString()));
 			}
 		}
 	}
-	return false;
+
+	emit plannedTunersChanged();
 }
-bool DvbRecordingModel::isInConflictWithAll(DvbSharedRecording rec, QList<DvbSharedRecording> recList)
-{
 
-	foreach(DvbSharedRecording listRec, recList)
-	{
-		if (!areInConflict(rec, listRec)) {
-			return false;
-		}
+QString DvbRecordingModel::getPlannedTuner(const DvbSharedRecording &recording) const
+{
+	if (!recording.isValid()) {
+		return QString();
 	}
 
-	return true;
+	return plannedTuners.value(*recording);
 }
 
-int DvbRecordingModel::getNumberOfLeastImportants(QList<DvbSharedRecording> recList)
+bool DvbRecordingModel::hasConflict(const DvbSharedRecording &recording) const
 {
-	DvbSharedRecording leastImportantShared = getLeastImportant(recList);
-	int leastImportance = leastImportantShared->priority;
-	int count = 0;
-	foreach(DvbSharedRecording listRecShared, recList)
-	{
-		if (listRecShared->priority == leastImportance) {
-			count = count + 1;
-		}
+	return (recording.isValid() && conflictingRecordings.contains(*recording));
+}
+
+void DvbRecordingModel::scheduleConflictCheck()
+{
+	// the plan is updated once after a series of changes
+	if (!conflictCheckPending) {
+		conflictCheckPending = true;
+		QMetaObject::invokeMethod(this, "checkConflicts", Qt::QueuedConnection);
+	}
+}
+
+void DvbRecordingModel::checkConflicts()
+{
+	if (!conflictCheckPending) {
+		return;
 	}
 
-	return count;
+	if (hasPendingOperation) {
+		// called from a nested event loop; try again later
+		conflictCheckPending = false;
+		scheduleConflictCheck();
+		return;
+	}
+
+	disableConflicts();
 }
 
-DvbSharedRecording DvbRecordingModel::getLeastImportant(QList<DvbSharedRecording> recList)
+void DvbRecordingModel::updateAutoRecordingRules()
 {
-	DvbSharedRecording leastImportant = recList.value(0);
-	foreach(DvbSharedRecording listRec, recList)
-	{
-		qCDebug(logDvb, "name and priority %s %d", qPrintable(listRec->name), listRec->priority);
-		if (listRec->priority < leastImportant->priority) {
-			leastImportant = listRec;
+	autoRecordingRules.clear();
+	QStringList regexList = manager->getRecordingRegexList();
+	QList<int> priorityList = manager->getRecordingRegexPriorityList();
+
+	for (int i = 0; i < regexList.size(); ++i) {
+		if (regexList.at(i).isEmpty()) {
+			continue;
 		}
+
+		QRegularExpression recordingRegex(regexList.at(i));
+
+		if (!recordingRegex.isValid()) {
+			qCWarning(logDvb, "Invalid recording regex %s: %s", qPrintable(regexList.at(i)),
+				qPrintable(recordingRegex.errorString()));
+			continue;
+		}
+
+		// the rules are applied to every epg entry
+		recordingRegex.optimize();
+		autoRecordingRules.append(qMakePair(recordingRegex, priorityList.value(i)));
 	}
 
-	qCDebug(logDvb, "least important: %s", qPrintable(leastImportant->name));
-	return leastImportant;
+	autoRecordingRulesValid = true;
 }
 
-void DvbRecordingModel::disableLeastImportants(QList<DvbSharedRecording> recList)
+void DvbRecordingModel::matchEpgEntry(const DvbSharedEpgEntry &entry)
 {
-	int numberOfLeastImportants = getNumberOfLeastImportants(recList);
-	if (numberOfLeastImportants < recList.size()) {
-		DvbSharedRecording leastImportantShared = getLeastImportant(recList);
-		int leastImportance = leastImportantShared->priority;
+	if (entry->recording.isValid()) {
+		return;
+	}
 
-		foreach(DvbSharedRecording listRecShared, recList)
-		{
-			DvbRecording listRec = *(listRecShared.constData());
-			if (listRecShared->priority == leastImportance) {
-				listRec.disabled = true;
-				updateRecording(listRecShared, listRec);
-				qCDebug(logDvb, "disabled: %s %s", qPrintable(listRec.name), qPrintable(listRec.begin.toString()));
+	QString title = entry->title(FIRST_LANG);
+
+	// the first matching rule determines the priority
+	for (int i = 0; i < autoRecordingRules.size(); ++i) {
+		if (autoRecordingRules.at(i).first.match(title).hasMatch()) {
+			if (!existsSimilarRecording(*entry)) {
+				manager->getEpgModel()->scheduleProgram(entry, manager->getBeginMargin(),
+					manager->getEndMargin(), false, autoRecordingRules.at(i).second);
+				qCDebug(logDvb, "scheduled %s", qPrintable(title));
 			}
+
+			break;
 		}
 	}
-
 }
 
 void DvbRecordingModel::findNewRecordings()
@@ -512,54 +716,142 @@ void DvbRecordingModel::findNewRecordings()
 	if (!epgModel)
 		return;
 
-	QMap<DvbEpgEntryId, DvbSharedEpgEntry> epgMap = epgModel->getEntries();
-	foreach(DvbEpgEntryId key, epgMap.keys())
-	{
-		DvbEpgEntry entry = *(epgMap.value(key));
-		QString title = entry.title(FIRST_LANG);
-		QStringList regexList = manager->getRecordingRegexList();
-		int i = 0;
-		foreach(QString regex, regexList) {
-			QRegExp recordingRegex = QRegExp(regex);
-			if (!recordingRegex.isEmpty())
-				{
-				if (recordingRegex.indexIn(title) != -1)
-				{
-					if (!DvbRecordingModel::existsSimilarRecording(*epgMap.value(key)))
-					{
-					int priority = manager->getRecordingRegexPriorityList().value(i);
-					epgModel->scheduleProgram(epgMap.value(key), manager->getBeginMargin(),
-							manager->getEndMargin(), false, priority);
-					qCDebug(logDvb, "scheduled %s", qPrintable(title));
-					}
-				}
-			}
-			i = i + 1;
-		}
+	// the rules or the margins may have changed
+	updateAutoRecordingRules();
+	similarRecordingsValid = false;
+	pendingEpgEntries.clear();
+
+	if (autoRecordingRules.isEmpty()) {
+		return;
+	}
+
+	foreach (const DvbSharedEpgEntry &entry, epgModel->getEntries()) {
+		matchEpgEntry(entry);
 	}
 
 	qCDebug(logDvb, "executed.");
 }
 
-void DvbRecordingModel::timerEvent(QTimerEvent *event)
+void DvbRecordingModel::epgEntryChanged(const DvbSharedEpgEntry &entry)
 {
-	Q_UNUSED(event)
-	QDateTime currentDateTime = QDateTime::currentDateTime().toUTC();
+	if (!autoRecordingRulesValid) {
+		updateAutoRecordingRules();
+	}
 
-	foreach (const DvbSharedRecording &recording, recordings) {
-		if (recording->end <= currentDateTime) {
-			DvbRecording modifiedRecording = *recording;
-			updateRecording(recording, modifiedRecording);
+	if (autoRecordingRules.isEmpty() || entry->recording.isValid()) {
+		return;
+	}
+
+	// the epg model doesn't allow scheduling while it emits signals
+	if (pendingEpgEntries.isEmpty()) {
+		QMetaObject::invokeMethod(this, "processPendingEpgEntries", Qt::QueuedConnection);
+	}
+
+	pendingEpgEntries.append(entry);
+}
+
+void DvbRecordingModel::processPendingEpgEntries()
+{
+	DvbEpgModel *epgModel = manager->getEpgModel();
+	QList<DvbSharedEpgEntry> epgEntries = pendingEpgEntries;
+	pendingEpgEntries.clear();
+
+	if ((epgModel == NULL) || epgEntries.isEmpty()) {
+		return;
+	}
+
+	// removed entries have already been dropped (see epgEntryRemoved())
+	foreach (const DvbSharedEpgEntry &entry, epgEntries) {
+		matchEpgEntry(entry);
+	}
+}
+
+void DvbRecordingModel::epgEntryRemoved(const DvbSharedEpgEntry &entry)
+{
+	if (!pendingEpgEntries.isEmpty()) {
+		pendingEpgEntries.removeAll(entry);
+	}
+}
+
+void DvbRecordingModel::scheduleRecordingEvent(const DvbRecording &recording)
+{
+	unscheduleRecordingEvent(recording);
+	QDateTime eventTime;
+
+	switch (recording.status) {
+	case DvbRecording::Inactive:
+		eventTime = recording.begin;
+		break;
+	case DvbRecording::Recording:
+		eventTime = recording.end;
+		break;
+	case DvbRecording::Error:
+		eventTime = recording.end;
+
+		if (!recording.disabled) {
+			// keep retrying if the device was busy / tuning failed
+			QDateTime retryTime = QDateTime::currentDateTime().toUTC().addSecs(5);
+
+			if (retryTime < eventTime) {
+				eventTime = retryTime;
+			}
 		}
+
+		break;
 	}
 
-	foreach (const DvbSharedRecording &recording, recordings) {
-		if ((recording->status != DvbRecording::Recording) &&
-		    (recording->begin <= currentDateTime)) {
+	recordingEvents.insert(eventTime, recording);
+	recordingEventTimes.insert(recording, eventTime);
+	updateRecordingTimer();
+}
+
+void DvbRecordingModel::unscheduleRecordingEvent(const SqlKey &sqlKey)
+{
+	QMap<SqlKey, QDateTime>::Iterator it = recordingEventTimes.find(sqlKey);
+
+	if (it != recordingEventTimes.end()) {
+		recordingEvents.remove(*it, sqlKey);
+		recordingEventTimes.erase(it);
+	}
+}
+
+void DvbRecordingModel::updateRecordingTimer()
+{
+	if (recordingEvents.isEmpty()) {
+		recordingTimer.stop();
+		return;
+	}
+
+	qint64 timeout = QDateTime::currentDateTime().msecsTo(recordingEvents.constBegin().key());
+
+	// the wall clock may jump (suspend, time adjustments); recheck at least once a minute
+	recordingTimer.start(int(qBound(Q_INT64_C(0), timeout, Q_INT64_C(60000))));
+}
+
+void DvbRecordingModel::recordingTimeout()
+{
+	if (hasPendingOperation) {
+		// called from a nested event loop
+		recordingTimer.start(1000);
+		return;
+	}
+
+	QDateTime currentDateTime = QDateTime::currentDateTime().toUTC();
+
+	while (!recordingEvents.isEmpty() &&
+	       (recordingEvents.constBegin().key() <= currentDateTime)) {
+		SqlKey sqlKey = recordingEvents.constBegin().value();
+		unscheduleRecordingEvent(sqlKey);
+		DvbSharedRecording recording = recordings.value(sqlKey);
+
+		// starts, stops or repeats the recording and schedules its next event
+		if (recording.isValid()) {
 			DvbRecording modifiedRecording = *recording;
 			updateRecording(recording, modifiedRecording);
 		}
 	}
+
+	updateRecordingTimer();
 }
 
 void DvbRecordingModel::bindToSqlQuery(SqlKey sqlKey, QSqlQuery &query, int index) const
@@ -609,6 +901,7 @@ bool DvbRecordingModel::insertFromSqlQuery(SqlKey sqlKey, const QSqlQuery &query
 	if (recording->validate()) {
 		recording->setSqlKey(sqlKey);
 		recordings.insert(*newRecording, newRecording);
+		scheduleRecordingEvent(*newRecording);
 		return true;
 	}
 
@@ -620,29 +913,36 @@ bool DvbRecordingModel::insertFromSqlQuery(SqlKey sqlKey, const QSqlQuery &query
  */
 int DvbRecordingModel::getSecondsUntilNextRecording() const
 {
-	signed long timeUntil = -1;
-	foreach (const DvbSharedRecording &recording, recordings) {
-		DvbRecording rec = *recording;
-		int length = 60 * 60 * rec.duration.hour() + 60 * rec.duration.minute() + rec.duration.second();
-		QDateTime end = rec.begin.addSecs(length);
-		if (rec.disabled || end < QDateTime::currentDateTime().toUTC()) {
-			continue;
-		}
-		if (end > QDateTime::currentDateTime().toUTC() && rec.begin <= QDateTime::currentDateTime().toUTC()) {
-			timeUntil = 0;
-			qCDebug(logDvb, "Rec ongoing %s", qPrintable(rec.name));
-			break;
+	QDateTime currentDateTime = QDateTime::currentDateTime().toUTC();
+
+	// started recordings (also those which are retried) have a recording file
+	for (QMap<SqlKey, QExplicitlySharedDataPointer<DvbRecordingFile> >::ConstIterator it =
+	     recordingFiles.constBegin(); it != recordingFiles.constEnd(); ++it) {
+		DvbSharedRecording recording = recordings.value(it.key());
+
+		if (recording.isValid() && !recording->disabled && (recording->end > currentDateTime)) {
+			qCDebug(logDvb, "Rec ongoing %s", qPrintable(recording->name));
+			return 0;
 		}
-		if (rec.begin > QDateTime::currentDateTime().toUTC()) {
-			if (timeUntil == -1 || timeUntil > rec.begin.toTime_t() - QDateTime::currentDateTime().toUTC().toTime_t()) {
-				timeUntil = rec.begin.toTime_t() - QDateTime::currentDateTime().toUTC().toTime_t();
-			}
+	}
+
+	// inactive recordings are queued by their begin
+	for (QMultiMap<QDateTime, SqlKey>::ConstIterator it = recordingEvents.constBegin();
+	     it != recordingEvents.constEnd(); ++it) {
+		DvbSharedRecording recording = recordings.value(it.value());
+
+		if (!recording.isValid() || recording->disabled ||
+		    (recording->status != DvbRecording::Inactive) ||
+		    (recording->end <= currentDateTime)) {
+			continue;
 		}
 
+		int timeUntil = qMax(0, int(currentDateTime.secsTo(recording->begin)));
+		qCDebug(logDvb, "returned TRUE %d", timeUntil);
+		return timeUntil;
 	}
 
-	qCDebug(logDvb, "returned TRUE %ld", timeUntil);
-	return timeUntil;
+	return -1;
 }
 
 bool DvbRecordingModel::isScanWhenIdle() const
@@ -736,6 +1036,13 @@ bool DvbRecordingModel::updateStatus(DvbRecording &recording)
 	}
 
 	if (recording.begin <= currentDateTime) {
+		if (conflictingRecordings.contains(recording) &&
+		    (recording.status != DvbRecording::Recording)) {
+			// no tuner is left; retried until a conflict check finds one
+			recording.status = DvbRecording::Error;
+			return true;
+		}
+
 		QExplicitlySharedDataPointer<DvbRecordingFile> recordingFile =
 			recordingFiles.value(recording);
 
@@ -757,9 +1064,423 @@ bool DvbRecordingModel::updateStatus(DvbRecording &recording)
 	return true;
 }
 
+DvbRecordingIndexer::DvbRecordingIndexer() : pcrPid(-1), lastPcr(-1)
+{
+}
+
+QByteArray DvbRecordingIndexer::header()
+{
+	char data[8] = { 'K', 'I', 'D', 'X', 0, 0, 0, 1 };
+	return QByteArray(data, sizeof(data));
+}
+
+void DvbRecordingIndexer::setPids(int videoPid, int videoStreamType, int pcrPid_)
+{
+	keyFrameDetector.setVideoPid(videoPid, videoStreamType);
+	pcrPid = ((pcrPid_ != 0x1fff) ? pcrPid_ : -1);
+	lastPcr = -1;
+}
+
+void DvbRecordingIndexer::reset()
+{
+	keyFrameDetector.setVideoPid(-1, -1);
+	pcrPid = -1;
+	lastPcr = -1;
+}
+
+static void appendIndexEntry(QByteArray &entries, qint64 offset, qint64 time, int type)
+{
+	uchar entry[16];
+	qToBigEndian(quint64(offset), entry);
+	qToBigEndian(quint64(time) | (quint64(type) << 56), entry + 8);
+	entries.append(reinterpret_cast<const char *>(entry), sizeof(entry));
+}
+
+void DvbRecordingIndexer::processPacket(const char *packet, qint64 offset, QByteArray &entries)
+{
+	const unsigned char *data = reinterpret_cast<const unsigned char *>(packet);
+	int pid = (((data[1] << 8) | data[2]) & ((1 << 13) - 1));
+	int videoPid = keyFrameDetector.getVideoPid();
+
+	if (((pid != videoPid) && (pid != pcrPid)) || ((data[1] & 0x80) != 0)) {
+		return;
+	}
+
+	int payloadStart = 4;
+
+	if ((data[3] & 0x20) != 0) {
+		int length = data[4];
+
+		if (length > 0) {
+			if ((pid == pcrPid) && ((data[5] & 0x10) != 0) && (length >= 7)) {
+				qint64 pcr = ((qint64(data[6]) << 25) | (data[7] << 17) | (data[8] << 9) |
+					(data[9] << 1) | (data[10] >> 7));
+
+				// one entry per second is enough for seeking (33 bit wrap around)
+				if ((lastPcr < 0) ||
+				    (((pcr - lastPcr) & ((Q_INT64_C(1) << 33) - 1)) >= 90000)) {
+					lastPcr = pcr;
+					appendIndexEntry(entries, offset, pcr, PcrEntry);
+				}
+			}
+		}
+
+		payloadStart = (5 + length);
+	}
+
+	// a pes with pts has to start in this packet
+	if ((pid != videoPid) || ((data[1] & 0x40) == 0) || ((data[3] & 0x10) == 0) ||
+	    ((payloadStart + 14) > 188)) {
+		return;
+	}
+
+	const unsigned char *pes = (data + payloadStart);
+
+	if ((pes[0] != 0) || (pes[1] != 0) || (pes[2] != 1) || ((pes[7] & 0x80) == 0)) {
+		return;
+	}
+
+	qint64 pts = ((qint64(pes[9] & 0x0e) << 29) | (pes[10] << 22) | ((pes[11] & 0xfe) << 14) |
+		(pes[12] << 7) | (pes[13] >> 1));
+
+	if (keyFrameDetector.isKeyFrame(packet)) {
+		appendIndexEntry(entries, offset, pts, RandomAccessEntry);
+	}
+}
+
+DvbRecordingWriter::DvbRecordingWriter() : opened(false), fd(-1), indexFd(-1), directIo(false),
+	writeIndex(0), currentSize(0), currentStartTime(0), position(0), readIndex(0), writtenBytes(0),
+	allocatedBytes(0), preallocate(false), failed(false), stopped(false), maximumLatency(0),
+	droppedBytes(0)
+{
+	for (int i = 0; i < BlockCount; ++i) {
+		blocks[i] = NULL;
+		blockSizes[i] = 0;
+		commitTimes[i] = 0;
+	}
+}
+
+DvbRecordingWriter::~DvbRecordingWriter()
+{
+	close();
+	wait();
+}
+
+bool DvbRecordingWriter::open(const QString &fileName_, bool directIo_)
+{
+	// a writer which is still busy with the previous file is replaced (see DvbRecordingFile)
+	Q_ASSERT(!opened && !isRunning());
+	QByteArray encodedName = QFile::encodeName(fileName_);
+	int flags = (O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC);
+	directIo = directIo_;
+
+	if (directIo) {
+		fd = ::open(encodedName.constData(), flags | O_DIRECT, 0666);
+
+		if ((fd < 0) && (errno == EINVAL)) {
+			// not supported by the file system
+			qCWarning(logDvb, "Cannot use direct io for %s", qPrintable(fileName_));
+			directIo = false;
+		}
+	}
+
+	if (!directIo) {
+		fd = ::open(encodedName.constData(), flags, 0666);
+	}
+
+	if (fd < 0) {
+		return false;
+	}
+
+	fileName = fileName_;
+
+	for (int i = 0; i < BlockCount; ++i) {
+		blocks[i] = static_cast<char *>(qMallocAligned(BlockSize, 4096));
+	}
+
+	writeIndex = 0;
+	currentSize = 0;
+	position = 0;
+	readIndex = 0;
+	usedBlocks = 0;
+	writtenBytes = 0;
+	allocatedBytes = 0;
+	preallocate = true;
+	failed = false;
+	stopped = false;
+	maximumLatency = 0;
+	droppedBytes = 0;
+	opened = true;
+	clock.start();
+	start();
+	return true;
+}
+
+bool DvbRecordingWriter::openIndex(const QString &indexFileName)
+{
+	Q_ASSERT(opened && (indexFd < 0));
+	indexFd = ::open(QFile::encodeName(indexFileName).constData(),
+		O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+	if (indexFd < 0) {
+		qCWarning(logDvb, "Cannot open index file %s", qPrintable(indexFileName));
+		return false;
+	}
+
+	currentIndexEntries = DvbRecordingIndexer::header();
+	return true;
+}
+
+void DvbRecordingWriter::close()
+{
+	if (!opened) {
+		return;
+	}
+
+	opened = false;
+
+	// there's always room for the current block (see write())
+	if (currentSize > 0) {
+		commitBlock();
+	}
+
+	// the writer thread writes the remaining blocks and closes the files (see finish())
+	mutex.lock();
+	stopped = true;
+	blockAvailable.wakeOne();
+	mutex.unlock();
+}
+
+bool DvbRecordingWriter::write(const char *data, int size)
+{
+	if (!opened) {
+		return false;
+	}
+
+	while (size > 0) {
+		if (usedBlocks.loadAcquire() >= BlockCount) {
+			// the disk can't keep up; the rest is dropped (at a packet boundary)
+			QMutexLocker locker(&mutex);
+			droppedBytes += size;
+			return false;
+		}
+
+		if (currentSize == 0) {
+			currentStartTime = clock.elapsed();
+		}
+
+		int amount = qMin(size, BlockSize - currentSize);
+		memcpy(blocks[writeIndex] + currentSize, data, amount);
+		currentSize += amount;
+		position += amount;
+		data += amount;
+		size -= amount;
+
+		if (currentSize == BlockSize) {
+			commitBlock();
+		}
+	}
+
+	return true;
+}
+
+void DvbRecordingWriter::addIndexEntries(const QByteArray &entries)
+{
+	if (indexFd >= 0) {
+		currentIndexEntries.append(entries);
+	}
+}
+
+void DvbRecordingWriter::flush(int maximumAge)
+{
+	// direct io needs aligned writes
+	if (opened && !directIo && (currentSize > 0) &&
+	    ((clock.elapsed() - currentStartTime) >= maximumAge)) {
+		commitBlock();
+	}
+}
+
+int DvbRecordingWriter::getBacklog() const
+{
+	return (usedBlocks.loadAcquire() * int(BlockSize));
+}
+
+void DvbRecordingWriter::getStatistics(int &maximumLatency_, qint64 &droppedBytes_)
+{
+	QMutexLocker locker(&mutex);
+	maximumLatency_ = maximumLatency;
+	droppedBytes_ = droppedBytes;
+	maximumLatency = 0;
+}
+
+void DvbRecordingWriter::commitBlock()
+{
+	blockSizes[writeIndex] = currentSize;
+	blockIndexEntries[writeIndex] = currentIndexEntries;
+	currentIndexEntries.clear();
+	commitTimes[writeIndex] = clock.elapsed();
+	writeIndex = ((writeIndex + 1) % BlockCount);
+	currentSize = 0;
+
+	if (usedBlocks.fetchAndAddOrdered(1) == 0) {
+		mutex.lock();
+		blockAvailable.wakeOne();
+		mutex.unlock();
+	}
+}
+
+void DvbRecordingWriter::writeBlock(const char *data, int size, const QByteArray &indexEntries)
+{
+	if (failed) {
+		return;
+	}
+
+	// large extents keep the file contiguous; the size is corrected in close()
+	if (preallocate && ((writtenBytes + size) > allocatedBytes)) {
+		if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocatedBytes, PreallocationSize) == 0) {
+			allocatedBytes += PreallocationSize;
+		} else {
+			// not supported by the file system
+			preallocate = false;
+		}
+	}
+
+	if (directIo && ((size % 4096) != 0)) {
+		// the last block of the recording
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+		directIo = false;
+	}
+
+	qint64 offset = writtenBytes;
+	int remaining = size;
+
+	while (remaining > 0) {
+		ssize_t bytes = ::write(fd, data, remaining);
+
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			qCWarning(logDvb, "Cannot write to file %s: error %d", qPrintable(fileName), errno);
+			failed = true;
+			return;
+		}
+
+		data += bytes;
+		remaining -= int(bytes);
+		writtenBytes += bytes;
+	}
+
+	if (!directIo) {
+		// start the writeback of this block; the previous one is dropped from the cache
+		sync_file_range(fd, offset, size, SYNC_FILE_RANGE_WRITE);
+
+		if (offset >= BlockSize) {
+			sync_file_range(fd, offset - BlockSize, BlockSize, SYNC_FILE_RANGE_WAIT_BEFORE |
+				SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+			posix_fadvise(fd, offset - BlockSize, BlockSize, POSIX_FADV_DONTNEED);
+		}
+	}
+
+	// the entries only refer to data which has been written
+	writeIndexEntries(indexEntries);
+}
+
+void DvbRecordingWriter::writeIndexEntries(const QByteArray &indexEntries)
+{
+	const char *data = indexEntries.constData();
+	int remaining = indexEntries.size();
+
+	while ((indexFd >= 0) && (remaining > 0)) {
+		ssize_t bytes = ::write(indexFd, data, remaining);
+
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			qCWarning(logDvb, "Cannot write index of %s: error %d", qPrintable(fileName),
+				errno);
+			::close(indexFd);
+			indexFd = -1;
+			return;
+		}
+
+		data += bytes;
+		remaining -= int(bytes);
+	}
+}
+
+void DvbRecordingWriter::run()
+{
+	while (true) {
+		mutex.lock();
+
+		while (!stopped && (usedBlocks.loadAcquire() == 0)) {
+			blockAvailable.wait(&mutex);
+		}
+
+		bool stop = stopped;
+		mutex.unlock();
+
+		if (usedBlocks.loadAcquire() == 0) {
+			if (stop) {
+				finish();
+				break;
+			}
+
+			continue;
+		}
+
+		writeBlock(blocks[readIndex], blockSizes[readIndex], blockIndexEntries[readIndex]);
+		blockIndexEntries[readIndex].clear();
+		int latency = int(clock.elapsed() - commitTimes[readIndex]);
+		readIndex = ((readIndex + 1) % BlockCount);
+		usedBlocks.fetchAndAddOrdered(-1);
+
+		mutex.lock();
+		maximumLatency = qMax(maximumLatency, latency);
+		mutex.unlock();
+	}
+}
+
+void DvbRecordingWriter::finish()
+{
+	// release the preallocated space beyond the end of the recording
+	if (allocatedBytes > writtenBytes) {
+		if (ftruncate(fd, writtenBytes) != 0) {
+			qCWarning(logDvb, "Cannot truncate file %s", qPrintable(fileName));
+		}
+	}
+
+	if (droppedBytes > 0) {
+		qCWarning(logDvb, "%lld bytes of %s were dropped because the disk was too slow",
+			droppedBytes, qPrintable(fileName));
+	}
+
+	::close(fd);
+	fd = -1;
+
+	if (indexFd >= 0) {
+		// entries which were added after the last block
+		writeIndexEntries(currentIndexEntries);
+		::close(indexFd);
+		indexFd = -1;
+	}
+
+	currentIndexEntries.clear();
+
+	for (int i = 0; i < BlockCount; ++i) {
+		qFreeAligned(blocks[i]);
+		blocks[i] = NULL;
+	}
+}
+
 DvbRecordingFile::DvbRecordingFile(DvbManager *manager_) : manager(manager_), device(NULL),
-	pmtValid(false)
+	pmtValid(false), entireTransponder(false)
 {
+	writer = new DvbRecordingWriter;
 	connect(&pmtFilter, SIGNAL(pmtSectionChanged(QByteArray)),
 		this, SLOT(pmtSectionChanged(QByteArray)));
 	connect(&patPmtTimer, SIGNAL(timeout()), this, SLOT(insertPatPmt()));
@@ -768,6 +1489,19 @@ DvbRecordingFile::DvbRecordingFile(DvbManager *manager_) : manager(manager_), de
 DvbRecordingFile::~DvbRecordingFile()
 {
 	stop();
+	releaseWriter();
+}
+
+void DvbRecordingFile::releaseWriter()
+{
+	// the remaining data is written in the background; the manager waits for it on exit
+	writer->setParent(manager);
+	connect(writer, SIGNAL(finished()), writer, SLOT(deleteLater()));
+
+	if (!writer->isRunning()) {
+		// not deleted right away, so that queued signals of the writer are delivered first
+		writer->deleteLater();
+	}
 }
 
 bool DvbRecordingFile::start(DvbRecording &recording)
@@ -776,7 +1510,16 @@ bool DvbRecordingFile::start(DvbRecording &recording)
 		return false;
 	}
 
-	if (!file.isOpen()) {
+	if (!writer->isOpen()) {
+		if (writer->isRunning()) {
+			// the previous file is still written out; don't wait for the disk
+			DvbRecordingWriter *newWriter = new DvbRecordingWriter;
+			releaseWriter();
+			mutex.lock();
+			writer = newWriter;
+			mutex.unlock();
+		}
+
 		QString folder = manager->getRecordingFolder();
 		QDate currentDate = QDate::currentDate();
 		QTime currentTime = QTime::currentTime();
@@ -798,25 +1541,31 @@ bool DvbRecordingFile::start(DvbRecording &recording)
 		QString path = folder + QLatin1Char('/') + filename;
 
 
+		QString fileName;
+		bool directIo = manager->useDirectRecordingIo();
+
 		for (int attempt = 0; attempt < 100; ++attempt) {
 			if (attempt == 0) {
-				file.setFileName(path + QLatin1String(".m2t"));
+				fileName = (path + QLatin1String(".m2t"));
 				recording.filename = filename + QLatin1String(".m2t");
 			} else {
-				file.setFileName(path + QLatin1Char('-') + QString::number(attempt) +
+				fileName = (path + QLatin1Char('-') + QString::number(attempt) +
 					QLatin1String(".m2t"));
 				recording.filename = filename + QLatin1Char('-') + QString::number(attempt) +
 					QLatin1String(".m2t");
 			}
 
-			if (file.exists()) {
+			if (QFile::exists(fileName)) {
 				continue;
 			}
 
-			if (file.open(QIODevice::WriteOnly)) {
+			if (writer->open(fileName, directIo)) {
+				// the recording stays usable without index
+				writer->openIndex(fileName.left(fileName.size() - 4) +
+					QLatin1String(".idx"));
 				break;
 			} else {
-				qCWarning(logDvb, "Cannot open file %s. Error: %d", qPrintable(file.fileName()), errno);
+				qCWarning(logDvb, "Cannot open file %s. Error: %d", qPrintable(fileName), errno);
 			}
 
 			if ((attempt == 0) && !QDir(folder).exists()) {
@@ -856,10 +1605,12 @@ bool DvbRecordingFile::start(DvbRecording &recording)
 			}
 		}
 
-		if (!file.isOpen()) {
-			qCWarning(logDvb, "Cannot open file %s", qPrintable(file.fileName()));
+		if (!writer->isOpen()) {
+			qCWarning(logDvb, "Cannot open file %s", qPrintable(fileName));
 			return false;
 		}
+
+		statisticsTimer.start();
 	}
 
 	if (device == NULL) {
@@ -885,6 +1636,17 @@ bool DvbRecordingFile::start(DvbRecording &recording)
 		pmtSectionData = channel->pmtSectionData;
 		patGenerator.initPat(channel->transportStreamId, channel->serviceId,
 			channel->pmtPid);
+		entireTransponder = manager->recordEntireTransponder();
+
+		if (entireTransponder) {
+			// the stream already contains the original tables
+			mutex.lock();
+			pmtValid = true;
+			mutex.unlock();
+
+			pids.append(0x2000);
+			device->addPidFilter(0x2000, this);
+		}
 
 		if (channel->isScrambled && !pmtSectionData.isEmpty()) {
 			device->startDescrambling(pmtSectionData, this);
@@ -913,18 +1675,23 @@ void DvbRecordingFile::stop()
 		device = NULL;
 	}
 
+	mutex.lock();
 	pmtValid = false;
+	buffers.clear();
+	writer->close();
+	indexer.reset();
+	mutex.unlock();
+
+	entireTransponder = false;
 	patPmtTimer.stop();
 	patGenerator.reset();
 	pmtGenerator.reset();
 	pmtSectionData.clear();
 	pids.clear();
-	buffers.clear();
-	file.close();
 	channel = DvbSharedChannel();
 
-	manager->getRecordingModel()->executeActionAfterRecording(manager->getRecordingModel()->getCurrentRecording());
-	manager->getRecordingModel()->findNewRecordings();
+	manager->getRecordingModel()->executeActionAfterWriting(
+		manager->getRecordingModel()->getCurrentRecording(), writer);
 	manager->getRecordingModel()->removeDuplicates();
 	manager->getRecordingModel()->disableConflicts();
 }
@@ -971,6 +1738,21 @@ void DvbRecordingFile::pmtSectionChanged(const QByteArray &pmtSectionData_)
 	DvbPmtSection pmtSection(pmtSectionData);
 	DvbPmtParser pmtParser(pmtSection);
 	int pcrPid = pmtSection.pcrPid();
+
+	if (pmtSection.isValid()) {
+		QMutexLocker locker(&mutex);
+		indexer.setPids(pmtParser.videoPid, pmtParser.videoStreamType, pcrPid);
+	}
+
+	if (entireTransponder) {
+		// the pmt is only needed for descrambling
+		if (channel->isScrambled) {
+			device->startDescrambling(pmtSectionData, this);
+		}
+
+		return;
+	}
+
 	QSet<int> newPids;
 
 	if (pmtParser.videoPid != -1) {
@@ -1014,12 +1796,13 @@ void DvbRecordingFile::pmtSectionChanged(const QByteArray &pmtSectionData_)
 	pmtGenerator.initPmt(channel->pmtPid, pmtSection, pids);
 
 	if (!pmtValid) {
+		QMutexLocker locker(&mutex);
 		pmtValid = true;
-		file.write(patGenerator.generatePackets());
-		file.write(pmtGenerator.generatePackets());
+		writer->write(patGenerator.generatePackets());
+		writer->write(pmtGenerator.generatePackets());
 
 		foreach (const QByteArray &buffer, buffers) {
-			file.write(buffer);
+			writePackets(buffer.constData(), buffer.size());
 		}
 
 		buffers.clear();
@@ -1040,32 +1823,99 @@ void DvbRecordingFile::insertPatPmt()
 		return;
 	}
 
-	file.write(patGenerator.generatePackets());
-	file.write(pmtGenerator.generatePackets());
+	QMutexLocker locker(&mutex);
+	writer->write(patGenerator.generatePackets());
+	writer->write(pmtGenerator.generatePackets());
+	// low bitrate recordings shouldn't linger in memory
+	writer->flush(2000);
+
+	if (statisticsTimer.elapsed() >= 10000) {
+		statisticsTimer.start();
+		int maximumLatency;
+		qint64 droppedBytes;
+		writer->getStatistics(maximumLatency, droppedBytes);
+		qCDebug(logDvb, "Recording %s: backlog %d KiB, maximum write latency %d ms, "
+			"%lld bytes dropped", qPrintable(writer->getFileName()), writer->getBacklog() / 1024,
+			maximumLatency, droppedBytes);
+
+		if (maximumLatency >= 2000) {
+			qCWarning(logDvb, "Writing %s is slow (%d ms per block)",
+				qPrintable(writer->getFileName()), maximumLatency);
+		}
+	}
+}
+
+void DvbRecordingFile::startPatPmtTimer()
+{
+	if (!pmtValid && !patPmtTimer.isActive()) {
+		patPmtTimer.start(1000);
+	}
 }
 
 void DvbRecordingFile::processData(const char data[188])
 {
+	processPackets(&data, 1);
+}
+
+void DvbRecordingFile::processPackets(const char *const *packets, int count)
+{
+	QMutexLocker locker(&mutex);
+
 	if (!pmtValid) {
-		if (!patPmtTimer.isActive()) {
-			patPmtTimer.start(1000);
+		if (buffers.isEmpty()) {
+			// the timer has to be started in the main thread
+			QMetaObject::invokeMethod(this, "startPatPmtTimer", Qt::QueuedConnection);
 			QByteArray nextBuffer;
 			nextBuffer.reserve(348 * 188);
 			buffers.append(nextBuffer);
 		}
 
-		QByteArray &buffer = buffers.last();
-		buffer.append(data, 188);
+		for (int i = 0; i < count; ++i) {
+			QByteArray &buffer = buffers.last();
+			buffer.append(packets[i], 188);
 
-		if (buffer.size() >= (348 * 188)) {
-			QByteArray nextBuffer;
-			nextBuffer.reserve(348 * 188);
-			buffers.append(nextBuffer);
+			if (buffer.size() >= (348 * 188)) {
+				QByteArray nextBuffer;
+				nextBuffer.reserve(348 * 188);
+				buffers.append(nextBuffer);
+			}
+		}
+
+		return;
+	}
+
+	// packets which are adjacent in memory are written at once
+	int i = 0;
+
+	while (i < count) {
+		const char *begin = packets[i];
+		const char *end = (begin + 188);
+
+		for (++i; (i < count) && (packets[i] == end); ++i) {
+			end += 188;
 		}
 
+		writePackets(begin, int(end - begin));
+	}
+}
+
+void DvbRecordingFile::writePackets(const char *data, int size)
+{
+	if (!indexer.isActive()) {
+		writer->write(data, size);
 		return;
 	}
 
-	file.write(data, 188);
+	qint64 position = writer->getPosition();
+	indexEntries.clear();
+
+	for (int offset = 0; offset < size; offset += 188) {
+		indexer.processPacket(data + offset, position + offset, indexEntries);
+	}
+
+	// entries for dropped data would point to the wrong place
+	if (writer->write(data, size) && !indexEntries.isEmpty()) {
+		writer->addIndexEntries(indexEntries);
+	}
 }
 
@@ -22,12 +22,18 @@
 #define DVBRECORDING_H
 
 #include <QDateTime>
+#include <QRegularExpression>
+#include <QSet>
 #include <QTextStream>
+#include <QTimer>
 #include "dvbchannel.h"
 
 class DvbManager;
 class DvbRecordingFile;
 class DvbEpgEntry;
+class QThread;
+
+typedef ExplicitlySharedDataPointer<const DvbEpgEntry> DvbSharedEpgEntry;
 
 class DvbRecording : public SharedData, public SqlKey
 {
@@ -85,18 +91,21 @@ public:
 	void updateRecording(DvbSharedRecording recording, DvbRecording &modifiedRecording);
 	void removeRecording(DvbSharedRecording recording);
 	void addToUnwantedRecordings(DvbSharedRecording recording);
+	// matches the whole epg against the auto recording rules (after the rules changed)
 	void findNewRecordings();
 	void removeDuplicates();
 	void executeActionAfterRecording(DvbRecording recording);
+	// the action is executed once 'writer' has written the remaining data
+	void executeActionAfterWriting(DvbRecording recording, QThread *writer);
 	DvbRecording getCurrentRecording();
 	void setCurrentRecording(DvbRecording _currentRecording);
 	void disableLessImportant(DvbSharedRecording &recording1, DvbSharedRecording &recording2);
-	bool areInConflict(DvbSharedRecording recording1, DvbSharedRecording recording2);
-	bool isInConflictWithAll(DvbSharedRecording rec, QList<DvbSharedRecording> recList);
-	int getNumberOfLeastImportants(QList<DvbSharedRecording> recList);
-	DvbSharedRecording getLeastImportant(QList<DvbSharedRecording> recList);
-	void disableLeastImportants(QList<DvbSharedRecording> recList);
+	// assigns the recordings to tuners; those which don't fit aren't started
 	void disableConflicts();
+	// frontend name of the tuner planned for the recording (empty if none)
+	QString getPlannedTuner(const DvbSharedRecording &recording) const;
+	// true if no tuner is left for the recording (see disableConflicts())
+	bool hasConflict(const DvbSharedRecording &recording) const;
 	int getSecondsUntilNextRecording() const;
 	bool isScanWhenIdle() const;
 	bool shouldWeScanChannels() const;
@@ -108,21 +117,58 @@ signals:
 	void recordingAboutToBeUpdated(const DvbSharedRecording &recording);
 	void recordingUpdated(const DvbSharedRecording &recording);
 	void recordingRemoved(const DvbSharedRecording &recording);
+	void plannedTunersChanged();
+
+private slots:
+	void checkConflicts();
+	void recordingTimeout();
+	void epgEntryChanged(const DvbSharedEpgEntry &entry);
+	void epgEntryRemoved(const DvbSharedEpgEntry &entry);
+	void processPendingEpgEntries();
+	void writerFinished();
 
 private:
-	void timerEvent(QTimerEvent *event);
+	void scheduleRecordingEvent(const DvbRecording &recording);
+	void unscheduleRecordingEvent(const SqlKey &sqlKey);
+	void updateRecordingTimer();
+	void scheduleConflictCheck();
 
 	void bindToSqlQuery(SqlKey sqlKey, QSqlQuery &query, int index) const;
 	bool insertFromSqlQuery(SqlKey sqlKey, const QSqlQuery &query, int index);
 	bool updateStatus(DvbRecording &recording);
-	bool existsSimilarRecording(DvbEpgEntry recording);
+	bool existsSimilarRecording(const DvbEpgEntry &entry);
+	void updateAutoRecordingRules();
+	void matchEpgEntry(const DvbSharedEpgEntry &entry);
+	void updateSimilarRecordings();
+	void insertSimilarRecording(const DvbRecording &recording);
 
 	DvbManager *manager;
 	QMap<SqlKey, DvbSharedRecording> recordings;
 	QList<DvbSharedRecording> unwantedRecordings;
 	QMap<SqlKey, QExplicitlySharedDataPointer<DvbRecordingFile> > recordingFiles;
+	QMap<QObject *, DvbRecording> pendingActions; // writer -> recording
 	bool hasPendingOperation;
+	bool conflictCheckPending;
+
+	// next start / stop instant of every recording, ordered by time
+	QMultiMap<QDateTime, SqlKey> recordingEvents;
+	QMap<SqlKey, QDateTime> recordingEventTimes;
+	QTimer recordingTimer;
+
 	DvbRecording currentRecording;
+	QMap<SqlKey, QString> plannedTuners;
+	QSet<SqlKey> conflictingRecordings; // not persistent
+
+	// auto recording rules (compiled once) and the epg entries which still have to be matched
+	QList<QPair<QRegularExpression, int> > autoRecordingRules;
+	bool autoRecordingRulesValid;
+	QList<DvbSharedEpgEntry> pendingEpgEntries;
+
+	// epg spans of the scheduled recordings (channel name -> begin -> end)
+	QHash<QString, QMultiMap<QDateTime, QDateTime> > similarRecordings;
+	qint64 similarRecordingLength; // maximum (seconds)
+	QSet<QString> unwantedRecordingKeys;
+	bool similarRecordingsValid;
 };
 
 void delay(int seconds);
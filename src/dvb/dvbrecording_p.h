@@ -21,15 +21,218 @@
 #ifndef DVBRECORDING_P_H
 #define DVBRECORDING_P_H
 
-#include <QFile>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMultiMap>
+#include <QMutex>
+#include <QThread>
 #include <QTimer>
+#include <QWaitCondition>
 #include "dvbchannel.h"
+#include "dvbrecording.h"
 #include "dvbsi.h"
 
 class DvbDevice;
 class DvbManager;
 class DvbRecording;
 
+/*
+ * plans which tuner serves which recording; every tuner keeps its planned recordings
+ * indexed by begin, so that only the overlapping ones have to be checked; recordings
+ * on the same transponder share a tuner
+ */
+
+class DvbRecordingScheduler
+{
+public:
+	DvbRecordingScheduler() { }
+	~DvbRecordingScheduler() { }
+
+	void addTuner(const QString &name, const QStringList &sources);
+
+	bool hasTuners() const
+	{
+		return !tuners.isEmpty();
+	}
+
+	// returns the index of the tuner or -1 if the recording doesn't fit anywhere
+	int schedule(const DvbSharedRecording &recording);
+
+	QString getTunerName(int index) const
+	{
+		return tuners.at(index).name;
+	}
+
+private:
+	class Interval
+	{
+	public:
+		QDateTime end;
+		QString source;
+		DvbTransponder transponder;
+	};
+
+	class Tuner
+	{
+	public:
+		Tuner() : maximumLength(0) { }
+		~Tuner() { }
+
+		QString name;
+		QStringList sources;
+		QMultiMap<QDateTime, Interval> intervals; // key = begin
+		qint64 maximumLength; // of all intervals (seconds)
+	};
+
+	// 'shared' is set if the recording would reuse an already planned transponder
+	bool fits(const Tuner &tuner, const DvbSharedRecording &recording, bool &shared) const;
+
+	QList<Tuner> tuners;
+};
+
+/*
+ * sidecar index of a recording ("<name>.idx"), so that players and tools can seek by
+ * time without scanning the stream; all values are big endian; the file starts with
+ * "KIDX" and a 4 byte version (1), followed by 16 byte entries:
+ *
+ * 8 bytes: offset of the packet in the recording
+ * 8 bytes: bits 0 - 32 time (90 kHz units), bits 56 - 63 entry type
+ *
+ * pcr entries (at most one per second) map the pcr to the position; random access
+ * entries carry the pts of a video pes which starts at a random access point (flagged
+ * in the adaptation field or detected from the mpeg-2 / h.264 / hevc start codes)
+ */
+
+class DvbRecordingIndexer
+{
+public:
+	enum EntryType {
+		PcrEntry = 1,
+		RandomAccessEntry = 2
+	};
+
+	DvbRecordingIndexer();
+	~DvbRecordingIndexer() { }
+
+	static QByteArray header();
+
+	void setPids(int videoPid, int videoStreamType, int pcrPid_);
+	void reset();
+
+	bool isActive() const
+	{
+		return ((keyFrameDetector.getVideoPid() >= 0) || (pcrPid >= 0));
+	}
+
+	// appends the entries for this packet
+	void processPacket(const char *packet, qint64 offset, QByteArray &entries);
+
+private:
+	DvbKeyFrameDetector keyFrameDetector;
+	int pcrPid;
+	qint64 lastPcr;
+};
+
+/*
+ * writes a recording from its own thread, so that a slow disk doesn't block the demux
+ * thread; the data is collected in large blocks, which are passed to the writer through
+ * a single producer / single consumer ring; if the ring is full, data is dropped
+ *
+ * without direct io, the written ranges are flushed and dropped from the page cache
+ * behind the writer; with direct io, only full blocks are written until close()
+ *
+ * close() doesn't wait for the remaining blocks; the writer thread closes the files
+ * once it has written them
+ */
+
+class DvbRecordingWriter : public QThread
+{
+public:
+	enum {
+		BlockSize = (4 * 47 * 4096), // a multiple of 188 and 4096 bytes (752 KiB)
+		BlockCount = 16,
+		PreallocationSize = (64 * 1024 * 1024)
+	};
+
+	DvbRecordingWriter();
+	~DvbRecordingWriter();
+
+	// main thread
+	bool open(const QString &fileName_, bool directIo_); // the file must not exist
+	bool openIndex(const QString &indexFileName); // optional; call after open()
+	void close(); // the remaining data is written in the background
+
+	bool isOpen() const
+	{
+		return opened;
+	}
+
+	QString getFileName() const
+	{
+		return fileName;
+	}
+
+	// producer side (must be serialized by the caller)
+	bool write(const char *data, int size); // returns false if data had to be dropped
+	bool write(const QByteArray &data)
+	{
+		return write(data.constData(), data.size());
+	}
+
+	// index entries are written after the data written so far
+	void addIndexEntries(const QByteArray &entries);
+	void flush(int maximumAge); // passes on an incomplete block after maximumAge ms
+
+	qint64 getPosition() const // bytes passed to write() and not dropped
+	{
+		return position;
+	}
+
+	// thread-safe
+	int getBacklog() const; // bytes
+	void getStatistics(int &maximumLatency, qint64 &droppedBytes); // resets maximumLatency
+
+private:
+	Q_DISABLE_COPY(DvbRecordingWriter)
+
+	void commitBlock();
+	void writeBlock(const char *data, int size, const QByteArray &indexEntries); // writer thread
+	void writeIndexEntries(const QByteArray &indexEntries);
+	void finish(); // writer thread
+	void run();
+
+	QString fileName;
+	bool opened; // producer side
+	int fd;
+	int indexFd;
+	bool directIo;
+	char *blocks[BlockCount];
+	int blockSizes[BlockCount];
+	QByteArray blockIndexEntries[BlockCount];
+	qint64 commitTimes[BlockCount]; // ms; relative to clock
+	QElapsedTimer clock;
+
+	int writeIndex; // only accessed by the producer
+	int currentSize; // of blocks[writeIndex]
+	qint64 currentStartTime;
+	QByteArray currentIndexEntries;
+	qint64 position;
+	int readIndex; // only accessed by the writer thread
+	QAtomicInt usedBlocks;
+
+	// only accessed by the writer thread (or while it isn't running)
+	qint64 writtenBytes;
+	qint64 allocatedBytes;
+	bool preallocate;
+	bool failed;
+
+	QMutex mutex;
+	QWaitCondition blockAvailable;
+	bool stopped; // protected by mutex
+	int maximumLatency; // protected by mutex
+	qint64 droppedBytes; // protected by mutex
+};
+
 class DvbRecordingFile : private QObject, public QSharedData, private DvbPidFilter
 {
 	Q_OBJECT
@@ -45,13 +248,22 @@ private slots:
 	void deviceStateChanged();
 	void pmtSectionChanged(const QByteArray &pmtSectionData_);
 	void insertPatPmt();
+	void startPatPmtTimer();
 
 private:
+	void releaseWriter(); // the writer finishes on its own
+
+	// called in the demux thread
 	void processData(const char data[188]);
+	void processPackets(const char *const *packets, int count);
+	void writePackets(const char *data, int size); // mutex must be held
 
 	DvbManager *manager;
 	DvbSharedChannel channel;
-	QFile file;
+	QMutex mutex; // protects writer, indexer, buffers and pmtValid against the demux thread
+	DvbRecordingWriter *writer;
+	DvbRecordingIndexer indexer;
+	QByteArray indexEntries;
 	QList<QByteArray> buffers;
 	DvbDevice *device;
 	QList<int> pids;
@@ -60,7 +272,9 @@ private:
 	DvbSectionGenerator patGenerator;
 	DvbSectionGenerator pmtGenerator;
 	QTimer patPmtTimer;
+	QElapsedTimer statisticsTimer;
 	bool pmtValid;
+	bool entireTransponder; // all pids are recorded (MPTS)
 };
 
 #endif /* DVBRECORDING_P_H */
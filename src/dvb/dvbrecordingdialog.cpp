@@ -242,6 +242,7 @@ void DvbRecordingTableModel::setRecordingModel(DvbRecordingModel *recordingModel
 		this, SLOT(recordingUpdated(DvbSharedRecording)));
 	connect(recordingModel, SIGNAL(recordingRemoved(DvbSharedRecording)),
 		this, SLOT(recordingRemoved(DvbSharedRecording)));
+	connect(recordingModel, SIGNAL(plannedTunersChanged()), this, SLOT(plannedTunersChanged()));
 	reset(recordingModel->getRecordings());
 }
 
@@ -260,6 +261,8 @@ QVariant DvbRecordingTableModel::headerData(int section, Qt::Orientation orienta
 			return i18nc("@title:column tv show", "Duration");
 		case 4:
 			return i18nc("@title:column tv show", "Disabled");
+		case 5:
+			return i18nc("@title:column tv show", "Tuner");
 		}
 	}
 
@@ -274,7 +277,7 @@ QVariant DvbRecordingTableModel::data(const QModelIndex &index, int role) const
 		switch (role) {
 		case Qt::DecorationRole:
 			if (index.column() == 0) {
-				if (recording->disabled) {
+				if (recording->disabled || recordingModel->hasConflict(recording)) {
 					return QIcon::fromTheme(QLatin1String("dialog-error"), QIcon(":dialog-error"));
 				}
 				switch (recording->status) {
@@ -307,6 +310,11 @@ QVariant DvbRecordingTableModel::data(const QModelIndex &index, int role) const
 					return i18n("Disabled");
 				}
 				return i18n("Enabled");
+			case 5:
+				if (recordingModel->hasConflict(recording)) {
+					return i18n("No tuner available");
+				}
+				return recordingModel->getPlannedTuner(recording);
 			}
 			break;
 		}
@@ -378,6 +386,15 @@ void DvbRecordingTableModel::recordingRemoved(const DvbSharedRecording &recordin
 	remove(recording);
 }
 
+void DvbRecordingTableModel::plannedTunersChanged()
+{
+	int rowCount = this->rowCount(QModelIndex());
+
+	if (rowCount > 0) {
+		emit dataChanged(index(0, 0), index(rowCount - 1, 5));
+	}
+}
+
 DvbRecordingEditor::DvbRecordingEditor(DvbManager *manager_, const DvbSharedRecording &recording_,
 	QWidget *parent) : QDialog(parent), manager(manager_), recording(recording_)
 {
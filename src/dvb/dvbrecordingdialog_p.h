@@ -82,7 +82,7 @@ public:
 
 	int columnCount() const
 	{
-		return 5;
+		return 6;
 	}
 
 	bool filterAcceptsItem(const DvbSharedRecording &recording) const
@@ -110,6 +110,7 @@ private slots:
 	void recordingAboutToBeUpdated(const DvbSharedRecording &recording);
 	void recordingUpdated(const DvbSharedRecording &recording);
 	void recordingRemoved(const DvbSharedRecording &recording);
+	void plannedTunersChanged();
 
 private:
 	DvbRecordingModel *recordingModel;
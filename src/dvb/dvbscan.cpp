@@ -25,6 +25,7 @@
 #include <stdint.h>
 
 #include "dvbdevice.h"
+#include "dvbmanager.h"
 #include "dvbscan.h"
 #include "dvbsi.h"
 
@@ -282,22 +283,22 @@ void DvbScanFilter::timerEvent(QTimerEvent *)
 }
 
 DvbScan::DvbScan(DvbDevice *device_, const QString &source_, const DvbTransponder &transponder_, bool useOtherNit_) :
-	device(device_), source(source_), transponder(transponder_), isLive(true), isAuto(false), useOtherNit(useOtherNit_),
+	manager(NULL), device(device_), source(source_), transponder(transponder_), isLive(true), isAuto(false), useOtherNit(useOtherNit_),
 	transponderIndex(-1), state(ScanPat), patIndex(0), activeFilters(0)
 {
 	qCDebug(logDvb, "Use other NIT is %s", useOtherNit ? "enabled" : "disabled");
 }
 
 DvbScan::DvbScan(DvbDevice *device_, const QString &source_,
-	const QList<DvbTransponder> &transponders_, bool useOtherNit_) : device(device_), source(source_),
+	const QList<DvbTransponder> &transponders_, bool useOtherNit_) : manager(NULL), device(device_), source(source_),
 	isLive(false), isAuto(false), useOtherNit(useOtherNit_), transponders(transponders_), transponderIndex(0),
 	state(ScanTune), patIndex(0), activeFilters(0)
 {
 	qCDebug(logDvb, "Use other NIT is %s", useOtherNit ? "enabled" : "disabled");
 }
 
-DvbScan::DvbScan(DvbDevice *device_, const QString &source_, const QString &autoScanSource, bool useOtherNit_) :
-	device(device_), source(source_), isLive(false), isAuto(true), useOtherNit(useOtherNit_), transponderIndex(0),
+DvbScan::DvbScan(DvbManager *manager_, DvbDevice *device_, const QString &source_,
+	const QString &autoScanSource, bool useOtherNit_) : manager(manager_), device(device_), source(source_), isLive(false), isAuto(true), useOtherNit(useOtherNit_), transponderIndex(0),
 	state(ScanTune), patIndex(0), activeFilters(0)
 {
 	qCDebug(logDvb, "Use other NIT is %s", useOtherNit ? "enabled" : "disabled");
@@ -813,7 +814,8 @@ void DvbScan::updateState()
 			if (!isAuto) {
 				device->tune(transponder);
 			} else {
-				device->autoTune(transponder);
+				device->autoTune(transponder,
+					manager->getAutoTuneHints(transponder.frequency()));
 			}
 
 			return;
@@ -829,6 +831,7 @@ void DvbScan::updateState()
 				if (isAuto) {
 					transponders[transponderIndex - 1] =
 						device->getAutoTransponder();
+					manager->addAutoTuneResult(device->getAutoTransponder());
 				}
 
 				state = ScanPat;
@@ -26,6 +26,7 @@
 class AtscVctSection;
 class DvbDescriptor;
 class DvbDevice;
+class DvbManager;
 class DvbNitSection;
 class DvbPatEntry;
 class DvbPatSection;
@@ -79,7 +80,9 @@ public:
 	DvbScan(DvbDevice *device_, const QString &source_, const DvbTransponder &transponder_, bool useOtherNit);
 	DvbScan(DvbDevice *device_, const QString &source_,
 		const QList<DvbTransponder> &transponders_, bool useOtherNit);
-	DvbScan(DvbDevice *device_, const QString &source_, const QString &autoScanSource, bool useOtherNit);
+	// auto-detected dvb-t parameters are remembered by the manager
+	DvbScan(DvbManager *manager_, DvbDevice *device_, const QString &source_,
+		const QString &autoScanSource, bool useOtherNit);
 	~DvbScan();
 
 	void start();
@@ -123,6 +126,7 @@ private:
 	void processNitDescriptor(const DvbDescriptor &descriptor);
 	void filterFinished(DvbScanFilter *filter);
 
+	DvbManager *manager; // only used if isAuto is true
 	DvbDevice *device;
 	QString source;
 	DvbTransponder transponder;
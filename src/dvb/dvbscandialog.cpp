@@ -460,7 +460,8 @@ void DvbScanDialog::scanButtonClicked(bool checked)
 				internal = new DvbScan(device, source,
 					manager->getTransponders(device, source), otherNitCheckBox->isChecked());
 			} else {
-				internal = new DvbScan(device, source, autoScanSource, otherNitCheckBox->isChecked());
+				internal = new DvbScan(manager, device, source, autoScanSource,
+					otherNitCheckBox->isChecked());
 			}
 		} else {
 			scanButton->setChecked(false);
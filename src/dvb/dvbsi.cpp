@@ -41,15 +41,60 @@ void DvbSection::initSection(const char *data, int size)
 	initSectionData(data, sectionLength, size);
 }
 
-int DvbStandardSection::verifyCrc32(const char *data, int size)
+/*
+ * slicing-by-8: tables[k][i] is the crc of byte i followed by k zero bytes, so
+ * that eight bytes can be processed with independent table lookups
+ */
+
+class DvbCrc32Tables
+{
+public:
+	DvbCrc32Tables()
+	{
+		for (int i = 0; i < 256; ++i) {
+			tables[0][i] = DvbStandardSection::crc32Table[i];
+		}
+
+		for (int k = 1; k < 8; ++k) {
+			for (int i = 0; i < 256; ++i) {
+				unsigned int value = tables[k - 1][i];
+				tables[k][i] = ((value << 8) ^ tables[0][value >> 24]);
+			}
+		}
+	}
+
+	~DvbCrc32Tables() { }
+
+	unsigned int tables[8][256];
+};
+
+static const DvbCrc32Tables crc32Tables;
+
+unsigned int DvbStandardSection::crc32(const char *data, int size)
 {
-	unsigned int crc32 = 0xffffffff;
+	const unsigned int (*tables)[256] = crc32Tables.tables;
+	const unsigned char *it = reinterpret_cast<const unsigned char *>(data);
+	const unsigned char *end = (it + size);
+	unsigned int crc = 0xffffffff;
 
-	for (int i = 0; i < size; ++i) {
-		crc32 = ((crc32 << 8) ^ crc32Table[(crc32 >> 24) ^ quint8(data[i])]);
+	for (; (end - it) >= 8; it += 8) {
+		crc ^= ((static_cast<unsigned int>(it[0]) << 24) | (it[1] << 16) | (it[2] << 8) |
+			it[3]);
+		crc = (tables[7][crc >> 24] ^ tables[6][(crc >> 16) & 0xff] ^
+			tables[5][(crc >> 8) & 0xff] ^ tables[4][crc & 0xff] ^
+			tables[3][it[4]] ^ tables[2][it[5]] ^ tables[1][it[6]] ^ tables[0][it[7]]);
 	}
 
-	return crc32;
+	for (; it != end; ++it) {
+		crc = ((crc << 8) ^ tables[0][(crc >> 24) ^ *it]);
+	}
+
+	return crc;
+}
+
+int DvbStandardSection::verifyCrc32(const char *data, int size)
+{
+	return int(crc32(data, size));
 }
 
 /*
@@ -1125,12 +1170,7 @@ void DvbSectionGenerator::endSection(int sectionLength, int pid)
 	data[12] = 0x00;
 
 	int size = sectionLength + 5;
-	unsigned int crc32 = 0xffffffff;
-
-	for (int i = 5; i < (size - 4); ++i) {
-		unsigned char byte = data[i];
-		crc32 = (crc32 << 8) ^ DvbStandardSection::crc32Table[(crc32 >> 24) ^ byte];
-	}
+	unsigned int crc32 = DvbStandardSection::crc32(data + 5, sectionLength - 4);
 
 	data[size - 4] = char(crc32 >> 24);
 	data[size - 3] = char(crc32 >> 16);
@@ -1154,7 +1194,8 @@ void DvbSectionGenerator::endSection(int sectionLength, int pid)
 	versionNumber = (versionNumber + 1) & 0x1f;
 }
 
-DvbPmtParser::DvbPmtParser(const DvbPmtSection &section) : videoPid(-1), teletextPid(-1)
+DvbPmtParser::DvbPmtParser(const DvbPmtSection &section) : videoPid(-1), videoStreamType(-1),
+	teletextPid(-1)
 {
 	for (DvbPmtSectionEntry entry = section.entries(); entry.isValid(); entry.advance()) {
 		QString streamLanguage;
@@ -1241,6 +1282,7 @@ DvbPmtParser::DvbPmtParser(const DvbPmtSection &section) : videoPid(-1), teletex
 		case 0xd1: // Dirac (Ultra HD video)
 			if (videoPid < 0) {
 				videoPid = entry.pid();
+				videoStreamType = entry.streamType();
 			} else {
 				qCInfo(logDvbSi, "More than one video PID");
 			}
@@ -1305,6 +1347,117 @@ DvbPmtParser::DvbPmtParser(const DvbPmtSection &section) : videoPid(-1), teletex
 	}
 }
 
+void DvbKeyFrameDetector::setVideoPid(int videoPid_, int videoStreamType)
+{
+	videoPid = videoPid_;
+
+	switch (videoStreamType) {
+	case 0x01:
+	case 0x02:
+	case 0x22:
+	case 0x80:
+		videoCodec = Mpeg2Codec;
+		break;
+	case 0x1b:
+	case 0x1f:
+	case 0x20:
+	case 0x23:
+		videoCodec = H264Codec;
+		break;
+	case 0x24:
+	case 0x25:
+	case 0x28:
+	case 0x29:
+	case 0x2a:
+	case 0x2b:
+		videoCodec = HevcCodec;
+		break;
+	default:
+		// only the random access indicator is used
+		videoCodec = OtherCodec;
+		break;
+	}
+}
+
+bool DvbKeyFrameDetector::isKeyFrame(const char *packet) const
+{
+	const unsigned char *data = reinterpret_cast<const unsigned char *>(packet);
+	int pid = (((data[1] << 8) | data[2]) & ((1 << 13) - 1));
+
+	if ((pid != videoPid) || ((data[1] & 0x80) != 0)) {
+		return false;
+	}
+
+	int payloadStart = 4;
+
+	if ((data[3] & 0x20) != 0) {
+		int length = data[4];
+
+		if ((length > 0) && ((data[5] & 0x40) != 0)) {
+			return true;
+		}
+
+		payloadStart = (5 + length);
+	}
+
+	if (((data[1] & 0x40) == 0) || ((data[3] & 0x10) == 0) || ((payloadStart + 9) > 188)) {
+		return false;
+	}
+
+	const unsigned char *pes = (data + payloadStart);
+
+	if ((pes[0] != 0) || (pes[1] != 0) || (pes[2] != 1) ||
+	    ((payloadStart + 9 + pes[8]) >= 188)) {
+		return false;
+	}
+
+	return containsKeyFrame(pes + 9 + pes[8], data + 188);
+}
+
+bool DvbKeyFrameDetector::containsKeyFrame(const unsigned char *data,
+	const unsigned char *end) const
+{
+	for (; (data + 5) < end; ++data) {
+		if ((data[0] != 0) || (data[1] != 0) || (data[2] != 1)) {
+			continue;
+		}
+
+		switch (videoCodec) {
+		case Mpeg2Codec:
+			// sequence header or intra coded picture
+			if ((data[3] == 0xb3) || ((data[3] == 0x00) && (((data[5] >> 3) & 0x07) == 1))) {
+				return true;
+			}
+
+			break;
+		case H264Codec: {
+			// idr picture or sequence parameter set
+			int nalUnitType = (data[3] & 0x1f);
+
+			if ((nalUnitType == 5) || (nalUnitType == 7)) {
+				return true;
+			}
+
+			break;
+		    }
+		case HevcCodec: {
+			// intra random access point picture or video parameter set
+			int nalUnitType = ((data[3] >> 1) & 0x3f);
+
+			if (((nalUnitType >= 16) && (nalUnitType <= 21)) || (nalUnitType == 32)) {
+				return true;
+			}
+
+			break;
+		    }
+		case OtherCodec:
+			return false;
+		}
+	}
+
+	return false;
+}
+
 void AtscEitSectionEntry::initEitSectionEntry(const char *data, int size)
 {
 	if (size < 12) {
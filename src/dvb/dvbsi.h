@@ -144,7 +144,8 @@ public:
 		return at(7);
 	}
 
-	static int verifyCrc32(const char *data, int size);
+	static unsigned int crc32(const char *data, int size);
+	static int verifyCrc32(const char *data, int size); // returns 0 if the crc is valid
 	static const unsigned int crc32Table[];
 
 protected:
@@ -324,11 +325,47 @@ public:
 	~DvbPmtParser() { }
 
 	int videoPid;
+	int videoStreamType;
 	QList<QPair<int, QString> > audioPids; // QString = language code (may be empty)
 	QList<QPair<int, QString> > subtitlePids; // QString = language code
 	int teletextPid;
 };
 
+/*
+ * recognizes the packets of a video pid which start a key frame: either the random access
+ * indicator is set or the pes starting in the packet contains a sequence header / intra
+ * picture (mpeg-2, h.264 and hevc; start codes split across packets are missed)
+ */
+
+class DvbKeyFrameDetector
+{
+public:
+	DvbKeyFrameDetector() : videoPid(-1), videoCodec(OtherCodec) { }
+	~DvbKeyFrameDetector() { }
+
+	void setVideoPid(int videoPid_, int videoStreamType);
+
+	int getVideoPid() const
+	{
+		return videoPid;
+	}
+
+	bool isKeyFrame(const char *packet) const;
+
+private:
+	enum VideoCodec {
+		OtherCodec,
+		Mpeg2Codec,
+		H264Codec,
+		HevcCodec
+	};
+
+	bool containsKeyFrame(const unsigned char *data, const unsigned char *end) const;
+
+	int videoPid;
+	VideoCodec videoCodec;
+};
+
 class AtscEitSectionEntry : public DvbSectionData
 {
 public:
@@ -103,6 +103,10 @@ DvbTab::DvbTab(QMenu *menu, KActionCollection *collection, MediaWidget *mediaWid
 	connect(osdAction, SIGNAL(triggered(bool)), manager->getLiveView(), SLOT(toggleOsd()));
 	menu->addAction(collection->addAction(QLatin1String("dvb_osd"), osdAction));
 
+	QAction *zapTimesAction = new QAction(QIcon::fromTheme(QLatin1String("player-time"), QIcon(":player-time")), i18n("Channel Change Times"), this);
+	connect(zapTimesAction, SIGNAL(triggered(bool)), manager->getLiveView(), SLOT(toggleZapTimesOsd()));
+	menu->addAction(collection->addAction(QLatin1String("dvb_zap_times"), zapTimesAction));
+
 	QAction *recordingsAction = new QAction(QIcon::fromTheme(QLatin1String("view-pim-calendar"), QIcon(":view-pim-calendar")),
 		i18nc("dialog", "Recording Schedule"), this);
 	recordingsAction->setShortcut(Qt::Key_R);
@@ -289,6 +293,11 @@ void DvbTab::enableDvbDump()
 	manager->enableDvbDump();
 }
 
+void DvbTab::addReplayDevice(const QString &path, bool paced)
+{
+	manager->addReplayDevice(path, paced);
+}
+
 void DvbTab::mouse_move(int x, int)
 {
 	if (!autoHideMenu)
@@ -62,6 +62,7 @@ public:
 	}
 
 	void enableDvbDump();
+	void addReplayDevice(const QString &path, bool paced);
 
 public slots:
 	void osdKeyPressed(int key);
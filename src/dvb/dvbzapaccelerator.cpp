@@ -0,0 +1,337 @@
+/*
+ * dvbzapaccelerator.cpp
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "../log.h"
+
+#include "dvbdevice.h"
+#include "dvbmanager.h"
+#include "dvbzapaccelerator.h"
+#include "dvbzapaccelerator_p.h"
+
+DvbZapAccelerator::DvbZapAccelerator(DvbManager *manager_) : QObject(manager_),
+	manager(manager_)
+{
+}
+
+DvbZapAccelerator::~DvbZapAccelerator()
+{
+	releaseDevices();
+}
+
+void DvbZapAccelerator::channelChanged(const DvbSharedChannel &channel)
+{
+	for (int i = 0; i < recentChannels.size(); ++i) {
+		if (DvbChannelId(recentChannels.at(i)) == DvbChannelId(channel)) {
+			recentChannels.removeAt(i);
+			break;
+		}
+	}
+
+	recentChannels.prepend(channel);
+
+	while (recentChannels.size() > (MaximumRecentChannels + 1)) {
+		recentChannels.removeLast();
+	}
+
+	if (!manager->isZapAccelerationEnabled()) {
+		releaseDevices();
+		return;
+	}
+
+	// most likely first
+	QList<DvbSharedChannel> candidates;
+	QMap<int, DvbSharedChannel> channels = manager->getChannelModel()->getChannels();
+	QMap<int, DvbSharedChannel>::ConstIterator it = channels.constFind(channel->number);
+
+	if (it != channels.constEnd()) {
+		if ((it + 1) != channels.constEnd()) {
+			candidates.append(*(it + 1));
+		}
+
+		if (it != channels.constBegin()) {
+			candidates.append(*(it - 1));
+		}
+	}
+
+	candidates.append(recentChannels.mid(1));
+
+	// the entry of 'channel' itself is kept for takeData()
+	for (int i = 0; i < entries.size(); ++i) {
+		DvbChannelId channelId(entries.at(i)->channel);
+		bool keep = (channelId == DvbChannelId(channel));
+
+		foreach (const DvbSharedChannel &candidate, candidates) {
+			if (channelId == DvbChannelId(candidate)) {
+				keep = true;
+				break;
+			}
+		}
+
+		if (!keep) {
+			removeEntry(i);
+			--i;
+		}
+	}
+
+	foreach (const DvbSharedChannel &candidate, candidates) {
+		if ((DvbChannelId(candidate) == DvbChannelId(channel)) ||
+		    (findEntry(NULL, candidate) >= 0)) {
+			continue;
+		}
+
+		// shares a device which is already tuned to the transponder or uses an idle one
+		DvbDevice *device = manager->requestDevice(candidate->source,
+			candidate->transponder, DvbManager::Standby);
+
+		if (device == NULL) {
+			continue;
+		}
+
+		qCDebug(logDvb, "Pre-tuning %s on %s", qPrintable(candidate->name),
+			qPrintable(device->getDeviceId()));
+		connect(device, SIGNAL(stateChanged()), this, SLOT(deviceStateChanged()),
+			Qt::UniqueConnection);
+		entries.append(new DvbZapAcceleratorEntry(device, candidate));
+	}
+}
+
+void DvbZapAccelerator::releaseDevices()
+{
+	while (!entries.isEmpty()) {
+		removeEntry(entries.size() - 1);
+	}
+}
+
+QByteArray DvbZapAccelerator::getPmtSection(const DvbDevice *device,
+	const DvbSharedChannel &channel) const
+{
+	int index = findEntry(device, channel);
+
+	if (index < 0) {
+		return QByteArray();
+	}
+
+	return entries.at(index)->getPmtSection();
+}
+
+QByteArray DvbZapAccelerator::takeData(const DvbDevice *device, const DvbSharedChannel &channel)
+{
+	int index = findEntry(device, channel);
+
+	if (index < 0) {
+		return QByteArray();
+	}
+
+	QByteArray data = entries.at(index)->takeData();
+	// the caller holds its own use of the device
+	removeEntry(index);
+	return data;
+}
+
+void DvbZapAccelerator::deviceStateChanged()
+{
+	// a device which was taken over is reacquired (or released if it was removed);
+	// the use counts have already been reset by the manager
+	for (int i = 0; i < entries.size(); ++i) {
+		DvbZapAcceleratorEntry *entry = entries.at(i);
+
+		if (entry->device->getDeviceState() == DvbDevice::DeviceReleased) {
+			disconnect(entry->device, SIGNAL(stateChanged()),
+				this, SLOT(deviceStateChanged()));
+			delete entry;
+			entries.removeAt(i);
+			--i;
+		}
+	}
+}
+
+int DvbZapAccelerator::findEntry(const DvbDevice *device, const DvbSharedChannel &channel) const
+{
+	// device == NULL matches every device
+	for (int i = 0; i < entries.size(); ++i) {
+		const DvbZapAcceleratorEntry *entry = entries.at(i);
+
+		if (((device == NULL) || (entry->device == device)) &&
+		    (DvbChannelId(entry->channel) == DvbChannelId(channel))) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void DvbZapAccelerator::removeEntry(int index)
+{
+	DvbZapAcceleratorEntry *entry = entries.takeAt(index);
+	DvbDevice *device = entry->device;
+	delete entry;
+	bool deviceUsed = false;
+
+	foreach (const DvbZapAcceleratorEntry *otherEntry, entries) {
+		if (otherEntry->device == device) {
+			deviceUsed = true;
+			break;
+		}
+	}
+
+	if (!deviceUsed) {
+		// releasing the last use emits DeviceReleased
+		disconnect(device, SIGNAL(stateChanged()), this, SLOT(deviceStateChanged()));
+	}
+
+	manager->releaseDevice(device, DvbManager::Standby);
+}
+
+DvbZapAcceleratorEntry::DvbZapAcceleratorEntry(DvbDevice *device_,
+	const DvbSharedChannel &channel_) : device(device_), channel(channel_), stopped(false),
+	dataTaken(false)
+{
+	pmtFilter.setProgramNumber(channel->serviceId);
+	connect(&pmtFilter, SIGNAL(pmtSectionChanged(QByteArray)),
+		this, SLOT(pmtSectionChanged(QByteArray)));
+	device->addSectionFilter(channel->pmtPid, &pmtFilter);
+	updatePids();
+}
+
+DvbZapAcceleratorEntry::~DvbZapAcceleratorEntry()
+{
+	stop();
+}
+
+void DvbZapAcceleratorEntry::stop()
+{
+	if (stopped) {
+		return;
+	}
+
+	stopped = true;
+
+	foreach (int pid, pids) {
+		device->removePidFilter(pid, this);
+	}
+
+	pids.clear();
+	device->removeSectionFilter(channel->pmtPid, &pmtFilter);
+}
+
+QByteArray DvbZapAcceleratorEntry::takeData()
+{
+	QMutexLocker locker(&mutex);
+	dataTaken = true;
+	QByteArray result = data;
+	data.clear();
+	return result;
+}
+
+void DvbZapAcceleratorEntry::pmtSectionChanged(const QByteArray &pmtSectionData_)
+{
+	pmtSectionData = pmtSectionData_;
+	updatePids();
+}
+
+void DvbZapAcceleratorEntry::updatePids()
+{
+	// the data of scrambled channels is only descrambled for the actual users
+	if (stopped || channel->isScrambled) {
+		return;
+	}
+
+	// start with the cached pmt of the channel
+	DvbPmtSection pmtSection(pmtSectionData.isEmpty() ? channel->pmtSectionData :
+		pmtSectionData);
+
+	if (!pmtSection.isValid()) {
+		return;
+	}
+
+	DvbPmtParser pmtParser(pmtSection);
+	QList<int> newPids;
+
+	// without video there isn't a key frame to start with, so that tuning has to suffice
+	if (pmtParser.videoPid >= 0) {
+		newPids.append(pmtParser.videoPid);
+
+		for (int i = 0; i < pmtParser.audioPids.size(); ++i) {
+			newPids.append(pmtParser.audioPids.at(i).first);
+		}
+
+		int pcrPid = pmtSection.pcrPid();
+
+		if ((pcrPid != 0x1fff) && !newPids.contains(pcrPid)) {
+			newPids.append(pcrPid);
+		}
+	}
+
+	mutex.lock();
+	keyFrameDetector.setVideoPid(pmtParser.videoPid, pmtParser.videoStreamType);
+
+	if ((pmtParser.videoPid >= 0) && (data.capacity() < MaximumDataSize)) {
+		data.reserve(MaximumDataSize);
+	}
+
+	mutex.unlock();
+
+	for (int i = 0; i < pids.size(); ++i) {
+		int pid = pids.at(i);
+
+		if (!newPids.removeOne(pid)) {
+			device->removePidFilter(pid, this);
+			pids.removeAt(i);
+			--i;
+		}
+	}
+
+	foreach (int pid, newPids) {
+		if (device->addPidFilter(pid, this)) {
+			pids.append(pid);
+		}
+	}
+}
+
+void DvbZapAcceleratorEntry::processData(const char packet[188])
+{
+	processPackets(&packet, 1);
+}
+
+void DvbZapAcceleratorEntry::processPackets(const char *const *packets, int count)
+{
+	QMutexLocker locker(&mutex);
+
+	if (dataTaken) {
+		return;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		const char *packet = packets[i];
+
+		if (keyFrameDetector.isKeyFrame(packet)) {
+			// only the last group of pictures is kept
+			data.resize(0);
+		} else if (data.isEmpty()) {
+			continue;
+		} else if (data.size() >= MaximumDataSize) {
+			// wait for the next key frame
+			data.resize(0);
+			continue;
+		}
+
+		data.append(packet, 188);
+	}
+}
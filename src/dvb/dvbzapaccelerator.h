@@ -0,0 +1,73 @@
+/*
+ * dvbzapaccelerator.h
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef DVBZAPACCELERATOR_H
+#define DVBZAPACCELERATOR_H
+
+#include <QList>
+#include "dvbchannel.h"
+
+class DvbDevice;
+class DvbManager;
+class DvbZapAcceleratorEntry;
+
+/*
+ * keeps the channels which are likely to be watched next (adjacent channel numbers and
+ * recently watched channels) tuned, so that switching to them doesn't have to wait for
+ * the frontend lock; the devices are requested as 'Standby', i.e. only idle devices are
+ * used and every other request (recordings in particular) takes them over
+ *
+ * the pmt of such a channel is tracked and the packets since the last key frame are kept,
+ * so that the live view can start with a picture right away
+ */
+
+class DvbZapAccelerator : public QObject
+{
+	Q_OBJECT
+public:
+	explicit DvbZapAccelerator(DvbManager *manager_);
+	~DvbZapAccelerator();
+
+	// called by the live view before it switches to 'channel'
+	void channelChanged(const DvbSharedChannel &channel);
+	void releaseDevices();
+
+	// empty if 'channel' isn't pre-tuned on 'device' or if the pmt hasn't been seen yet
+	QByteArray getPmtSection(const DvbDevice *device, const DvbSharedChannel &channel) const;
+	// packets since the last key frame (or empty); the channel isn't pre-tuned afterwards
+	QByteArray takeData(const DvbDevice *device, const DvbSharedChannel &channel);
+
+private slots:
+	void deviceStateChanged();
+
+private:
+	enum {
+		MaximumRecentChannels = 3 // in addition to the current one
+	};
+
+	int findEntry(const DvbDevice *device, const DvbSharedChannel &channel) const;
+	void removeEntry(int index);
+
+	DvbManager *manager;
+	QList<DvbSharedChannel> recentChannels; // most recent first
+	QList<DvbZapAcceleratorEntry *> entries;
+};
+
+#endif /* DVBZAPACCELERATOR_H */
@@ -0,0 +1,78 @@
+/*
+ * dvbzapaccelerator_p.h
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef DVBZAPACCELERATOR_P_H
+#define DVBZAPACCELERATOR_P_H
+
+#include <QMutex>
+#include "dvbbackenddevice.h"
+#include "dvbchannel.h"
+#include "dvbsi.h"
+
+class DvbDevice;
+
+// one pre-tuned channel; holds a 'Standby' use of the device
+
+class DvbZapAcceleratorEntry : public QObject, public DvbPidFilter
+{
+	Q_OBJECT
+public:
+	DvbZapAcceleratorEntry(DvbDevice *device_, const DvbSharedChannel &channel_);
+	~DvbZapAcceleratorEntry();
+
+	void stop(); // removes the filters; the device is still acquired
+	QByteArray takeData();
+
+	QByteArray getPmtSection() const
+	{
+		return pmtSectionData;
+	}
+
+	DvbDevice *device;
+	DvbSharedChannel channel;
+
+private slots:
+	void pmtSectionChanged(const QByteArray &pmtSectionData_);
+
+private:
+	enum {
+		// 1.5 MiB; a group of pictures of hd video and well within the margin of the
+		// live view ring (DvbLiveViewStream::Capacity / 8)
+		MaximumDataSize = 188 * 8192
+	};
+
+	void updatePids();
+
+	// called in the demux thread
+	void processData(const char packet[188]);
+	void processPackets(const char *const *packets, int count);
+
+	DvbPmtFilter pmtFilter;
+	QByteArray pmtSectionData;
+	QList<int> pids;
+	bool stopped;
+
+	QMutex mutex; // protects the members below against the demux thread
+	DvbKeyFrameDetector keyFrameDetector;
+	QByteArray data; // starts with a key frame (or is empty)
+	bool dataTaken;
+};
+
+#endif /* DVBZAPACCELERATOR_P_H */
@@ -478,6 +478,8 @@ MainWindow::MainWindow(KAboutData *aboutData, QCommandLineParser *parser)
 
 #if HAVE_DVB == 1
 	parser->addOption(QCommandLineOption(QStringList() << QLatin1String("dumpdvb"), i18nc("command line option", "Dump dvb data (debug option)")));
+	parser->addOption(QCommandLineOption(QStringList() << QLatin1String("replaydvb"), i18nc("command line option", "Add a virtual dvb device replaying a transport stream (debug option)"), QLatin1String("file / fifo / directory")));
+	parser->addOption(QCommandLineOption(QStringList() << QLatin1String("replaydvbfast"), i18nc("command line option", "Replay dvb data as fast as possible instead of following the pcr (debug option)")));
 	parser->addOption(QCommandLineOption(QStringList() << QLatin1String("channel"), i18nc("command line option", "Play TV channel"), QLatin1String("name / number")));
 	parser->addOption(QCommandLineOption(QStringList() << QLatin1String("tv"), i18nc("command line option", "(deprecated option)"), QLatin1String("channel")));
 	parser->addOption(QCommandLineOption(QStringList() << QLatin1String("lastchannel"), i18nc("command line option", "Play last tuned TV channel")));
@@ -562,6 +564,10 @@ void MainWindow::parseArgs(const QString workingDirectory)
 	if (parser->isSet("dumpdvb")) {
 		dvbTab->enableDvbDump();
 	}
+
+	if (parser->isSet("replaydvb")) {
+		dvbTab->addReplayDevice(parser->value("replaydvb"), !parser->isSet("replaydvbfast"));
+	}
 #endif
 
 	/*
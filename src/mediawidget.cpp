@@ -749,7 +749,14 @@ int MediaWidget::getVolume() const
 
 int MediaWidget::getPosition() const
 {
-	return backend->getCurrentTime();
+	int currentTime = backend->getCurrentTime();
+
+	if (source->overrideSeeking()) {
+		int totalTime = backend->getTotalTime();
+		source->validateCurrentTotalTime(currentTime, totalTime);
+	}
+
+	return currentTime;
 }
 
 void MediaWidget::play()
@@ -764,6 +771,11 @@ void MediaWidget::togglePause()
 
 void MediaWidget::setPosition(int position)
 {
+	if (source->overrideSeeking()) {
+		source->seek(position);
+		return;
+	}
+
 	backend->seek(position);
 }
 
@@ -925,7 +937,7 @@ void MediaWidget::seek(int position)
 		return;
 	}
 
-	backend->seek(position);
+	setPosition(position);
 }
 
 void MediaWidget::deinterlacingChanged(QAction *action)
@@ -1045,37 +1057,37 @@ void MediaWidget::timeButtonClicked()
 void MediaWidget::longSkipBackward()
 {
 	int longSkipDuration = Configuration::instance()->getLongSkipDuration();
-	int currentTime = (backend->getCurrentTime() - 1000 * longSkipDuration);
+	int currentTime = (getPosition() - 1000 * longSkipDuration);
 
 	if (currentTime < 0) {
 		currentTime = 0;
 	}
 
-	backend->seek(currentTime);
+	setPosition(currentTime);
 }
 
 void MediaWidget::shortSkipBackward()
 {
 	int shortSkipDuration = Configuration::instance()->getShortSkipDuration();
-	int currentTime = (backend->getCurrentTime() - 1000 * shortSkipDuration);
+	int currentTime = (getPosition() - 1000 * shortSkipDuration);
 
 	if (currentTime < 0) {
 		currentTime = 0;
 	}
 
-	backend->seek(currentTime);
+	setPosition(currentTime);
 }
 
 void MediaWidget::shortSkipForward()
 {
 	int shortSkipDuration = Configuration::instance()->getShortSkipDuration();
-	backend->seek(backend->getCurrentTime() + 1000 * shortSkipDuration);
+	setPosition(getPosition() + 1000 * shortSkipDuration);
 }
 
 void MediaWidget::longSkipForward()
 {
 	int longSkipDuration = Configuration::instance()->getLongSkipDuration();
-	backend->seek(backend->getCurrentTime() + 1000 * longSkipDuration);
+	setPosition(getPosition() + 1000 * longSkipDuration);
 }
 
 void MediaWidget::jumpToPosition()
@@ -1274,7 +1286,8 @@ void MediaWidget::currentTotalTimeChanged()
 
 void MediaWidget::seekableChanged()
 {
-	bool seekable = (backend->isSeekable() && !source->hideCurrentTotalTime());
+	bool seekable = ((backend->isSeekable() || source->overrideSeeking()) &&
+		!source->hideCurrentTotalTime());
 	seekSlider->setEnabled(seekable);
 	navigationMenu->setEnabled(seekable);
 	jumpToPositionAction->setEnabled(seekable);
@@ -1341,13 +1354,13 @@ void MediaWidget::wheelEvent(QWheelEvent *event)
 {
 	int shortSkipDuration = Configuration::instance()->getShortSkipDuration();
 	int currentTime =
-		(backend->getCurrentTime() - ((25 * shortSkipDuration * event->delta()) / 3));
+		(getPosition() - ((25 * shortSkipDuration * event->delta()) / 3));
 
 	if (currentTime < 0) {
 		currentTime = 0;
 	}
 
-	backend->seek(currentTime);
+	setPosition(currentTime);
 }
 
 void MediaWidget::playbackFinished()
@@ -1559,6 +1572,11 @@ void MediaWidget::videoSizeChanged()
 	setVideoSize();
 }
 
+void MediaWidget::videoOutputStarted()
+{
+	source->videoOutputStarted();
+}
+
 JumpToPositionDialog::JumpToPositionDialog(MediaWidget *mediaWidget_) : QDialog(mediaWidget_),
 	mediaWidget(mediaWidget_)
 {
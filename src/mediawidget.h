@@ -23,6 +23,7 @@
 
 #include <QWidget>
 #include <QIcon>
+#include <QSharedPointer>
 #include <QWeakPointer>
 #include <QUrl>
 #include <QToolBar>
@@ -40,6 +41,7 @@ class QWidgetAction;
 
 class AbstractMediaWidget;
 class MediaSource;
+class MediaStream;
 class OsdWidget;
 class SeekSlider;
 
@@ -161,6 +163,7 @@ public:
 	void anglesChanged();
 	void dvdMenuChanged();
 	void videoSizeChanged();
+	void videoOutputStarted();
 
 signals:
 	void displayModeChanged();
@@ -257,6 +260,27 @@ private:
 	bool showElapsedTime;
 };
 
+/*
+ * data which is passed to the backend in memory; all functions except interrupt() are
+ * called from a thread of the backend
+ */
+
+class MediaStream
+{
+public:
+	MediaStream() { }
+	virtual ~MediaStream() { }
+
+	virtual bool open() = 0;
+	// blocks until data is available; returns 0 at the end of the stream or after interrupt()
+	virtual int read(char *data, int size) = 0;
+	virtual bool seek(qint64 position) = 0; // bytes since the start of the stream
+	virtual void close() = 0;
+
+	// wakes up a blocked read(); needed before the backend can stop
+	virtual void interrupt() = 0;
+};
+
 class MediaSource
 {
 public:
@@ -278,8 +302,13 @@ public:
 
 	virtual Type getType() const { return Url; }
 	virtual QUrl getUrl() const { return QUrl(); }
+	// backends which support custom i/o read the stream instead of the url
+	virtual QSharedPointer<MediaStream> getStream() const { return QSharedPointer<MediaStream>(); }
 	virtual void validateCurrentTotalTime(int &, int &) const { }
 	virtual bool hideCurrentTotalTime() const { return false; }
+	// the source seeks itself (times as returned by validateCurrentTotalTime())
+	virtual bool overrideSeeking() const { return false; }
+	virtual void seek(int ) { }
 	virtual bool overrideAudioStreams() const { return false; }
 	virtual bool overrideSubtitles() const { return false; }
 	virtual QStringList getAudioStreams() const { return QStringList(); }
@@ -294,6 +323,7 @@ public:
 	virtual void metadataChanged(const QMap<MediaWidget::MetadataType, QString> &) { }
 	virtual void playbackFinished() { }
 	virtual void playbackStatusChanged(MediaWidget::PlaybackStatus ) { }
+	virtual void videoOutputStarted() { }
 	virtual void replay() { }
 	virtual void previous() { }
 	virtual void next() { }
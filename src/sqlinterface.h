@@ -58,6 +58,11 @@ public:
 		return (sqlKey < other.sqlKey);
 	}
 
+	friend uint qHash(const SqlKey &key)
+	{
+		return key.sqlKey;
+	}
+
 	quint32 sqlKey;
 };
 